@@ -1,16 +1,60 @@
 #include "AI.hh"
+#include "attacks.hh"
+#include "move-picker.hh"
 #include "rule-checker.hh"
 #include "plugin-auxiliary.hh"
 #include "parser.hh"
+#include "network-api/common.hh"
+#include <algorithm>
 #include <experimental/random>
 
-AI::AI(plugin::Color color) 
+constexpr std::array<int, 8> AI::passed_bonus;
+
+AI::Worker::Worker(unsigned id)
+  : id(id)
+  , best_move(CompactMove::none())
+  , max_depth(0)
+{
+  for (auto& moves : counter_moves)
+    moves.fill(CompactMove::none());
+  for (auto& side : history)
+    for (auto& scores : side)
+      scores.fill(0);
+}
+
+AI::AI(plugin::Color color, const AIOptions& options)
   : Player(color) 
   , opponent_color_(!color)
-  , best_move_(nullptr)
+  , best_move_(CompactMove::none())
   , board_()
     , scripted_moves_()
+  , tt_(options.hash_megabytes)
+  , reductions_(options.reductions)
+  , multi_pv_(std::max(options.multi_pv, 1u))
+  , time_left_(network_api::ktimeout_dur)
+  , stop_(false)
+  , ponder_(options.ponder)
+  , pondering_(false)
+  , ponder_move_(CompactMove::none())
+  , random_(std::random_device()())
 {
+  for (unsigned id = 0; id < std::max(options.threads, 1u); ++id)
+    workers_.emplace_back(std::make_unique<Worker>(id));
+  for (int d = 0; d < 64; ++d)
+    for (int n = 0; n < 64; ++n)
+      lmr_table_[d][n] = d == 0 or n == 0 ? 0
+        : std::max(0., reductions_.lmr_base
+            + std::log(d) * std::log(n) / reductions_.lmr_divisor);
+  if (not options.json_log.empty())
+    json_log_.open(options.json_log, std::ios::app);
+  if (not options.book.empty() and not book_.open(options.book))
+    std::cerr << "Cannot open the book " << options.book << std::endl;
+  if (not options.tablebase.empty()
+      and not tablebase_.open(options.tablebase))
+    std::cerr << "Cannot open the tablebase " << options.tablebase
+              << std::endl;
+  if (not options.network.empty() and not network_.load(options.network))
+    std::cerr << "Cannot read the network " << options.network << std::endl;
   //std::cerr << "my color is " << color_ << " and my opponent color is " << opponent_color_ << std::endl;
 }
 
@@ -21,15 +65,41 @@ void AI::set_scripted_moves(std::vector<std::shared_ptr<Move>> moves)
     std::cerr << *m << std::endl;
 }
 
+AI::~AI()
+{
+  if (ponder_thread_.joinable())
+  {
+    stop_ = true;
+    ponder_thread_.join();
+  }
+}
+
 std::string AI::play_next_move(const std::string& received_move)
 {
+  bool ponder_hit = false;
   if (received_move != "") {
     auto pos = received_move.find_last_of(' ');
     std::string move = received_move.substr(pos + 1);
     auto opponent_move = Parser::parse_uci(move, opponent_color_, board_);
+    ponder_hit = ponder_thread_.joinable()
+      and board_.compact_get(*opponent_move) == ponder_move_;
     board_.apply_move(*opponent_move);
-    permanent_history_board_.push_back(board_.board_get());
   }
+  // The search of a wrong guess is worth nothing, the right one goes on
+  // against the clock
+  auto start = steady_clock::now();
+  if (ponder_hit)
+  {
+    deadlines_set();
+    pondering_ = false;
+  }
+  else
+    stop_ = true;
+  if (ponder_thread_.joinable())
+    ponder_thread_.join();
+  pondering_ = false;
+  ponder_move_ = CompactMove::none();
+
   if (scripted_moves_.size() != 0)
   {
     auto move = scripted_moves_.front();
@@ -41,144 +111,259 @@ std::string AI::play_next_move(const std::string& received_move)
     return input;
   }
   else {
-    best_move_ = nullptr;
+    best_move_ = CompactMove::none();
     std::cerr << std::endl;
 
-    temporary_history_board_.push_back(&board_);
     //board_.pretty_print();
 
-    std::vector<std::shared_ptr<Move>> moves = RuleChecker::possible_moves(board_, color_);
+    MoveList moves = RuleChecker::possible_moves(board_, color_);
     if (moves.size() == 1)
     {
-      Move& only_move = *moves[0];
+      CompactMove only_move = moves[0];
       std::cerr << "Only move possible is : " << only_move << std::endl;
       board_.apply_move(only_move);
-      permanent_history_board_.push_back(board_.board_get());
       std::string input = only_move.to_an();
       return input;
     }
-    size_t nb_possible_moves = moves.size();
-    //max_depth_ = std::round(std::log2(3.5 / c_) / std::log2(new_possible_nb + 7));
-    max_depth_ = std::round(std::log2(5 / (c_ * nb_possible_moves)) / std::log2(20) + 1);
-    const int min_max_dept = 2;
-    if (max_depth_ < min_max_dept)
-      max_depth_ = min_max_dept;
-    //max_depth_ = 1;
-    std::cerr << nb_possible_moves << " moves possible, max_depth_ = " << max_depth_ << std::endl;
-    //float estimated_time = c_ * nb_possible_moves * std::pow(20, max_depth_ - 1);
-    std::cerr << "Estimated time: " << estimate_time(nb_possible_moves) << std::endl;
-    std::cerr << "one depth less: " << estimate_time(nb_possible_moves, max_depth_ - 1) << std::endl
-              << "one_depth_more: " << estimate_time(nb_possible_moves, max_depth_ + 1) << std::endl;
-    int best_move_value;
-    double time = 0;
+    if (book_.is_open())
+    {
+      CompactMove book_move = book_.probe(board_, random_);
+      if (book_move != CompactMove::none())
+      {
+        time_left_ -= std::chrono::duration<double>(
+            steady_clock::now() - start).count();
+        board_.apply_move(book_move);
+        return book_move.to_an();
+      }
+    }
+    CompactMove tablebase_move = tablebase_move_get();
+    if (tablebase_move != CompactMove::none())
     {
-      scoped_timer timer(time);
-      best_move_value = minimax(0, color_, -10000000, 10000000);
+      time_left_ -= std::chrono::duration<double>(
+          steady_clock::now() - start).count();
+      board_.apply_move(tablebase_move);
+      return tablebase_move.to_an();
     }
-    std::cerr << "Time : " << time << std::endl;
-    c_ = time / (nb_possible_moves * std::pow(20, max_depth_ - 1));
-    if (best_move_ == nullptr)
+    SearchResult result;
+    if (ponder_hit)
+      result = ponder_result_;
+    else
+    {
+      search_prepare();
+      deadlines_set();
+      result = search();
+    }
+    // Counts the nodes of the iteration left unfinished too
+    SearchReport report = report_get(result.value, start);
+    report.depth = result.report.depth;
+    report.pv = result.report.pv;
+    report.lines = result.report.lines;
+    time_left_ -= report.seconds;
+    std::cerr << "Time : " << report.seconds << std::endl;
+    best_move_ = result.move;
+    if (best_move_ == CompactMove::none())
     {
       std::cerr << "I am doomed" << std::endl;
       best_move_ = moves[0];
     }
-    temporary_history_board_.pop_back();
-    std::cerr << "Best move is : " << *best_move_ << " (score: " << best_move_value << ")" << std::endl;
-    board_.apply_move(*best_move_);
-    permanent_history_board_.push_back(board_.board_get());
-    std::string input = best_move_->to_an();
+    std::cerr << "Best move is : " << best_move_ << " (score: " << result.value << ")" << std::endl;
+    board_.apply_move(best_move_);
+    if (best_move_ == result.move)
+      ponder_move_ = result.reply;
+    if (json_log_.is_open())
+      json_log_ << report.json(best_move_) << std::endl;
+    std::string input = best_move_.to_an();
     std::cerr << std::endl;
     return input;
   }
 }
 
-float AI::estimate_time(int nb_possible_moves, int max_depth)
+// Searches the position after the reply the last search expects, until
+// play_next_move tells whether the opponent played it
+void AI::ponder()
 {
-  if (max_depth < 0)
-    max_depth = max_depth_;
-  return c_ * nb_possible_moves * std::pow(20, max_depth - 1);
+  if (not ponder_ or ponder_move_ == CompactMove::none())
+    return;
+  search_prepare();
+  for (auto& worker : workers_)
+    worker->board.apply_move(ponder_move_);
+  pondering_ = true;
+  ponder_thread_ = std::thread([this] { ponder_result_ = search(); });
 }
 
-int AI::get_piece_bonus_position(plugin::Color color, plugin::PieceType piece, const plugin::Position& pos)
+void AI::search_prepare()
 {
-  int file = ~pos.file_get();
-  int rank = ~pos.rank_get();
-  if (color == plugin::Color::WHITE)
-    rank = 7 - rank;
-  switch (piece)
+  tt_.new_search();
+  stop_ = false;
+  for (auto& worker : workers_)
   {
-    case plugin::PieceType::PAWN:
-      return pawn_weight_board[rank][file];
-    case plugin::PieceType::QUEEN:
-      return queen_weight_board[rank][file];
-    case plugin::PieceType::ROOK:
-      return rook_weight_board[rank][file];
-    case plugin::PieceType::BISHOP:
-      return bishop_weight_board[rank][file];
-    case plugin::PieceType::KING:
-      return king_middle_weight_board[rank][file];
-    case plugin::PieceType::KNIGHT:
-      return knight_weight_board[rank][file];
-    default:
-      return 0;
+    worker->board = board_;
+    if (network_.is_loaded())
+      worker->accumulator.attach(worker->board, network_);
+    worker->killers.fill({CompactMove::none(), CompactMove::none()});
+    // Older cutoffs matter less in the new position
+    for (auto& side : worker->history)
+      for (auto& scores : side)
+        for (int& score : scores)
+          score /= 2;
+    worker->stats.clear();
+    worker->root_excluded.clear();
   }
 }
 
-int AI::board_bonus_position(const ChessBoard& board)
+// Iterative deepening on the workers' boards, until a deadline or stop_
+AI::SearchResult AI::search()
 {
-  int bonus_pos = 0;
-  int pawn = 0, queen = 0, rook = 0, bishop = 0, knight = 0;
-
-  for (auto j = 0; j < 8; j++)
+  Worker& main = *workers_[0];
+  auto start = steady_clock::now();
+  SearchResult result = {CompactMove::none(), CompactMove::none(), 0, {}};
+  std::vector<std::thread> helpers;
+  for (size_t i = 1; i < workers_.size(); ++i)
+    helpers.emplace_back(&AI::helper_search, this, std::ref(*workers_[i]));
+  MoveList root_moves;
+  main.board.generate_moves(main.board.side_to_move_get(), root_moves);
+  std::vector<PrincipalVariation> lines(
+      std::min<size_t>(multi_pv_, std::max<size_t>(root_moves.size(), 1)),
+      {0, {}});
+  // Each iteration searches the best move of the previous one first. In
+  // Multi-PV mode, each line is searched again without the first moves of
+  // the lines before, around its own previous score. The transposition
+  // table carries over from line to line.
+  for (main.max_depth = 1; main.max_depth < max_ply / 2; ++main.max_depth)
   {
-    for (auto i = 0; i < 8; i++)
+    main.root_excluded.clear();
+    for (auto& line : lines)
     {
-      auto pos = plugin::Position(static_cast<plugin::File>(i), static_cast<plugin::Rank>(j));
-      auto piece_type = board.piecetype_get(pos);
-      auto piece_color = board.color_get(pos);
-      int positive_if_ai_color = (piece_color == color_) ? 1 : -1;
-
-      if (piece_type != std::experimental::nullopt)
-      {
-        switch(piece_type.value()) {
-          case plugin::PieceType::PAWN:
-            pawn += positive_if_ai_color;
-            break;
-          case plugin::PieceType::QUEEN:
-            queen += positive_if_ai_color;
-            break;
-          case plugin::PieceType::ROOK:
-            rook += positive_if_ai_color;
-            break;
-          case plugin::PieceType::BISHOP:
-            bishop += positive_if_ai_color;
-            break;
-          case plugin::PieceType::KNIGHT:
-            knight += positive_if_ai_color;
-            break;
-          default:
-            break;
-        }
-        /*if (piece_color == plugin::Color::BLACK)
-          bonus_pos += get_piece_bonus_position(piece_type.value(), i, j);
-        else
-          bonus_pos += get_piece_bonus_position(piece_type.value(), 7 - i, 7 - j);*/
-      }
+      line.score = root_search(main, line.score);
+      if (stop_)
+        break;
+      line.moves.assign(main.pv[0].begin(),
+                        main.pv[0].begin() + main.pv_length[0]);
+      if (line.moves.empty())
+        line.moves.push_back(main.best_move);
+      main.root_excluded.push(line.moves[0]);
     }
+    if (stop_)
+      break;
+    // Search instability may leave a line scoring above an earlier one
+    std::stable_sort(lines.begin(), lines.end(),
+        [](const PrincipalVariation& a, const PrincipalVariation& b) {
+          return a.score > b.score;
+        });
+    int value = lines[0].score;
+    result.move = lines[0].moves[0];
+    result.reply =
+      lines[0].moves.size() > 1 ? lines[0].moves[1] : CompactMove::none();
+    result.value = value;
+    result.report = report_get(value, start);
+    result.report.pv = lines[0].moves;
+    if (lines.size() > 1)
+      result.report.lines = lines;
+    // The connection is not ours while the opponent thinks
+    if (info_ and not pondering_)
+    {
+      if (lines.size() > 1)
+        for (size_t n = 0; n < lines.size(); ++n)
+          info_(result.report.line_get(n).uci_info());
+      else
+        info_(result.report.uci_info());
+    }
+    // A deeper search does not find a shorter mate than one within the
+    // depth. A longer one may come from the transposition table.
+    if (mate_value - std::abs(value) <= main.max_depth
+        or (not pondering_ and steady_clock::now() >= soft_deadline_))
+      break;
   }
+  stop_ = true;
+  for (auto& helper : helpers)
+    helper.join();
+  return result;
+}
 
-  return 900 * queen + 500 * rook + 300 * bishop + 300 * knight + 100 * pawn + 0.5 * bonus_pos;
+// Counters of all the threads, the principal variation of the main one
+SearchReport AI::report_get(int score, steady_clock::time_point start) const
+{
+  const Worker& main = *workers_[0];
+  SearchReport report;
+  report.depth = main.max_depth;
+  report.score = score;
+  report.seconds =
+    std::chrono::duration<double>(steady_clock::now() - start).count();
+  report.hashfull = tt_.hashfull();
+  report.pv.assign(main.pv[0].begin(), main.pv[0].begin() + main.pv_length[0]);
+  for (auto& worker : workers_)
+    report.stats += worker->stats;
+  return report;
 }
 
+// The game clock is shared by all moves, each search gets a slice of what
+// is left. Past the soft deadline no iteration starts, at the hard one the
+// iteration in progress is dropped.
+void AI::deadlines_set()
+{
+  const double moves_to_go = 40;
+  double soft = time_left_ / moves_to_go;
+  double hard = std::min(4 * soft, time_left_ / 8);
+  auto now = steady_clock::now();
+  soft_deadline_ = now + duration_cast<steady_clock::duration>(
+      std::chrono::duration<double>(soft));
+  hard_deadline_ = now + duration_cast<steady_clock::duration>(
+      std::chrono::duration<double>(hard));
+}
 
-int AI::evaluation_function(const ChessBoard& board)
+// Helpers do not report anything, they stop with the main thread. Odd ones
+// start a ply deeper so that the threads do not all search the same depth.
+void AI::helper_search(Worker& worker)
 {
-  int king_tropism = 0;
-  int bonus_pos = 0;
-  int pawn = 0, queen = 0, rook = 0, bishop = 0, knight = 0;
-  int op_pawn = 0, op_queen = 0, op_rook = 0, op_bishop = 0, op_knight = 0;
+  int value = 0;
+  for (worker.max_depth = 1 + worker.id % 2;
+       worker.max_depth < max_ply / 2 and not stop_; ++worker.max_depth)
+    value = root_search(worker, value);
+}
+
+// Aspiration windows: the root is first searched in a narrow window around
+// the score of the previous iteration. The side the score falls out of is
+// widened, twice as much each time, until the score falls inside.
+int AI::root_search(Worker& worker, int previous_value)
+{
+  int delta = aspiration_window;
+  int A = -infinity;
+  int B = infinity;
+  // Shallow scores swing too much, mate scores depend on the depth
+  if (worker.max_depth >= 4 and std::abs(previous_value) < mate_bound)
+  {
+    A = previous_value - delta;
+    B = previous_value + delta;
+  }
+  while (true)
+  {
+    worker.best_move = CompactMove::none();
+    int value = minimax(worker, 0, worker.max_depth, color_, A, B);
+    if (stop_)
+      return value;
+    if (value <= A)
+      A = std::max(value - delta, -infinity);
+    else if (value >= B)
+      B = std::min(value + delta, infinity);
+    else
+      return value;
+    delta *= 2;
+  }
+}
 
+// Scores tend towards history_max, large bonuses move them further
+void AI::history_update(Worker& worker, plugin::Color color, CompactMove move,
+                        int bonus)
+{
+  int& score =
+    worker.history[static_cast<bool>(color)][move.from_get()][move.to_get()];
+  score += bonus - score * std::abs(bonus) / history_max;
+}
 
+int AI::evaluation_function(const ChessBoard& board,
+                            const PawnTable::Entry& pawns)
+{
+  int king_tropism = 0;
 
   auto king_pos = board.get_king_position(color_);
   auto op_king_pos = board.get_king_position(opponent_color_);
@@ -188,38 +373,28 @@ int AI::evaluation_function(const ChessBoard& board)
   bool left_king_file_empty = true;
   bool right_king_file_empty = true;
 
-  int double_count = 0;
-  int op_double_count = 0;
-  
-  for (auto i = 0; i < 8; i++)
+  /* Distance of every cell to the king, pieces below adjust their own */
+  king_tropism = 8 * (distance_sum(~king_pos.file_get())
+      + distance_sum(~king_pos.rank_get()));
+
+  for (auto color : {plugin::Color::WHITE, plugin::Color::BLACK})
   {
-    int nb_pawn_file = 0;
-    int op_nb_pawn_file = 0;
-    for (auto j = 0; j < 8; j++)
+    for (auto piece_type : plugin::piecetype_array())
     {
-      auto file = static_cast<plugin::File>(i);
-      auto rank = static_cast<plugin::Rank>(j);
-      auto pos = plugin::Position(file, rank);
-      auto piece_type = board.piecetype_get(pos);
-      auto piece_color = board.color_get(pos);
-      int me = (piece_color == color_) ? 1 : -1;
-
-      /**************************************
-       * 
-       * Material Count and King Tropism Count
-       *
-       ***************************************/
-
-      auto dist = auxiliary::distance(pos, king_pos);
-
-      if (piece_type != std::experimental::nullopt)
+      const auto& squares = board.piece_list_get(color, piece_type);
+      for (int n = 0; n < board.piece_count_get(color, piece_type); ++n)
       {
+        auto pos = bitboard::position_of(squares[n]);
+        int i = ~pos.file_get();
 
-        /* Attacking Our King Zone */
-        /*if (piece_color == opponent_color_)
-          value_of_attack = king_zone_attack(king_pos, piece_type, value_of_attack, i, j);
-          else
-          opponent_value_of_attack = king_zone_attack(op_king_pos, piece_type, opponent_value_of_attack, i, j); */
+        /**************************************
+         * 
+         * King Tropism Count
+         *
+         ***************************************/
+
+        auto dist = auxiliary::distance(pos, king_pos);
+        auto cell_dist = dist;
 
         /* Calculating king file disadvantage */
         if (~i == ~king_file - 1)
@@ -227,66 +402,23 @@ int AI::evaluation_function(const ChessBoard& board)
         else if (~i == ~king_file + 1)
           right_king_file_empty = false;
 
-        if (piece_color == color_)
+        if (color == color_)
         {
-          switch(piece_type.value()) {
-            case plugin::PieceType::PAWN:
-              pawn++;
-              nb_pawn_file++;
-              break;
+          switch(piece_type) {
             case plugin::PieceType::QUEEN:
-              queen++;
               dist *= 2;
               break;
             case plugin::PieceType::ROOK:
-              rook++;
-              dist *= 0.5;
-              break;
             case plugin::PieceType::BISHOP:
-              bishop++;
               dist *= 0.5;
               break;
-            case plugin::PieceType::KNIGHT:
-              knight++;
-              break;
             default:
               break;
           }
         }
-        else 
-        {
-          switch(piece_type.value()) {
-            case plugin::PieceType::PAWN:
-              op_pawn++;
-              op_nb_pawn_file++;
-              break;
-            case plugin::PieceType::QUEEN:
-              op_queen++;
-              break;
-            case plugin::PieceType::ROOK:
-              op_rook++;
-              break;
-            case plugin::PieceType::BISHOP:
-              op_bishop++;
-              break;
-            case plugin::PieceType::KNIGHT:
-              op_knight++;
-              break;
-            default:
-              break;
-          }
-        }
-        bonus_pos += get_piece_bonus_position(piece_color, piece_type.value(), plugin::Position(file, rank)) * me;
+        king_tropism += dist - cell_dist;
       }
-
-      king_tropism += dist;
     }
-
-    if (nb_pawn_file >= 2) // Double count
-      double_count++;
-    if (op_nb_pawn_file >= 2)
-      op_double_count++;
-
   }
 
   /**************************************
@@ -295,15 +427,15 @@ int AI::evaluation_function(const ChessBoard& board)
    *
    ***************************************/
   int material_bonus = 0;
-  if (bishop > 1)
+  if (board.piece_count_get(color_, plugin::PieceType::BISHOP) > 1)
     material_bonus += 50;
-  if (op_bishop > 1)
+  if (board.piece_count_get(opponent_color_, plugin::PieceType::BISHOP) > 1)
     material_bonus -= 50;
   
   // lack of pawns
-  if (!pawn)
+  if (!board.piece_count_get(color_, plugin::PieceType::PAWN))
     material_bonus -= 10;
-  if (!op_pawn)
+  if (!board.piece_count_get(opponent_color_, plugin::PieceType::PAWN))
     material_bonus +=10;
 
   /**************************************
@@ -312,8 +444,8 @@ int AI::evaluation_function(const ChessBoard& board)
    *
    ***************************************/
 
-  material_bonus += pawn_shield(board, king_pos);
-  material_bonus -= pawn_shield(board, op_king_pos);
+  material_bonus += king_shield(pawns, color_, king_pos);
+  material_bonus -= king_shield(pawns, opponent_color_, op_king_pos);
 
 
   /*************************************
@@ -328,22 +460,37 @@ int AI::evaluation_function(const ChessBoard& board)
     king_file_malus = 20;
 
 
-  /******************/
+  /*************************************
+   *
+   * Attacks on the king zone
+   *
+   *************************************/
+
+  int phase = std::min(board.phase_get(), piece_square::phase_max);
+  int king_zone = (king_zone_attacks(board, opponent_color_)
+      - king_zone_attacks(board, color_)) * king_zone_weight * phase
+    / piece_square::phase_max;
 
-  //int attacking_king_zone = value_of_attack * attack_weight[piece_attacking]/ 100;
-  //int opponent_attacking_king_zone = opponent_value_of_attack * attack_weight[opponent_piece_attacking] / 100;
-  //std::cerr << "there is " << queen << " queen" << std::endl;
+  /******************/
 
-  int piece_material = 900 * (queen - op_queen) + 500 * (rook - op_rook) + 300 * (bishop - op_bishop) + 300 * (knight - op_knight) + 100 * (pawn - op_pawn);
-  int pawn_formation = double_count - op_double_count + count_isolated(color_) - count_isolated(opponent_color_);
+  /* Material and piece-square sums are kept by the board, the middlegame
+   * and endgame ones are blended by the phase of the game */
+  int piece_material = board.material_get(color_)
+    - board.material_get(opponent_color_);
+  int bonus_pos = ((board.psqt_middle_get(color_)
+        - board.psqt_middle_get(opponent_color_)) * phase
+      + (board.psqt_end_get(color_) - board.psqt_end_get(opponent_color_))
+        * (piece_square::phase_max - phase)) / piece_square::phase_max;
+  int pawn_formation = color_ == plugin::Color::WHITE ? pawns.score
+    : -pawns.score;
   bonus_pos *= 0.2;
   king_tropism *= 0.2;
   int total = piece_material + material_bonus 
     + bonus_pos 
     + king_tropism 
-    - 50 * pawn_formation
-    - king_file_malus;
-  //  + (opponent_attacking_king_zone - attacking_king_zone);
+    + pawn_formation
+    - king_file_malus
+    + king_zone;
   /*std::cout << "material " << piece_material << " material bonus " << material_bonus << " king trop " << king_tropism << " position " << bonus_pos <<
     std::endl << " total " << total << std::endl;*/
   return total;
@@ -351,101 +498,229 @@ int AI::evaluation_function(const ChessBoard& board)
 }
 
 
-int AI::king_zone_attack(plugin::Position king_pos, std::experimental::optional<plugin::PieceType> piece_type, int value_of_attack, int i , int j)
+// Sum of the distances from coord to every coordinate of a file or a rank
+int AI::distance_sum(int coord)
 {
-  int piece_attacking = 0;
-  int nb_squares_attacked = 0;
-
-  if (abs(static_cast<int>(king_pos.file_get()) - i) <= 2 && abs(static_cast<int>(king_pos.rank_get()) - j) <= 2)
-  {
-    piece_attacking++;
-    nb_squares_attacked = /* call to function */ 1;
+  return coord * (coord + 1) / 2 + (7 - coord) * (8 - coord) / 2;
+}
 
-    switch(piece_type.value())
-    {
-      case plugin::PieceType::QUEEN:
-        value_of_attack += nb_squares_attacked * 80;
-        break;
-      case plugin::PieceType::ROOK:
-        value_of_attack += nb_squares_attacked * 40;
-        break;
-      case plugin::PieceType::BISHOP:
-        value_of_attack += nb_squares_attacked * 20;
-        break;
-      case plugin::PieceType::KNIGHT:
-        value_of_attack += nb_squares_attacked * 20;
-        break;
-      default:
-        break;
-    }
-  }
-  return value_of_attack;
+// The board keeps how many pieces attack each square
+int AI::king_zone_attacks(const ChessBoard& board, plugin::Color color)
+{
+  using bitboard::bitboard_t;
+  bitboard::square_t king =
+    bitboard::lsb(board.pieces_bb(color, plugin::PieceType::KING));
+  bitboard_t zone = attacks::king_attacks(king) | bitboard::square_bb(king);
+  int count = 0;
+  while (zone)
+    count += board.attack_count_get(!color, bitboard::pop_lsb(zone));
+  return count;
 }
 
 
-int AI::pawn_shield(const ChessBoard& board, plugin::Position king_pos)
+// Pawn terms of the pawns of board, into the table entry of their key
+void AI::pawn_structure_evaluate(const ChessBoard& board,
+                                 PawnTable::Entry& entry)
 {
-  auto pawn_file = static_cast<int>(king_pos.file_get()) - 1;
-  int pawn_shield_count = 0;
-
-  for (auto i = 0; i <= 2; i++)
+  using bitboard::bitboard_t;
+  entry.key = board.pawn_key_get();
+  entry.score = 0;
+  for (bool color : {false, true})
   {
-    pawn_file += i;
-    plugin::Position pawn_pos(static_cast<plugin::File>(pawn_file), static_cast<plugin::Rank>(static_cast<int>(king_pos.rank_get()) + 1));
-
-    auto piece = board.piecetype_get(pawn_pos); 
-    if (piece != std::experimental::nullopt && piece == plugin::PieceType::PAWN && board.color_get(pawn_pos) == color_)
-      pawn_shield_count += 1;
+    bitboard_t pawns = board.pieces_bb(static_cast<plugin::Color>(color),
+                                       plugin::PieceType::PAWN);
+    bitboard_t enemies = board.pieces_bb(static_cast<plugin::Color>(!color),
+                                         plugin::PieceType::PAWN);
+    int score = 0;
+    entry.files[color] = 0;
+    entry.passed[color] = bitboard::empty;
+    entry.isolated[color] = bitboard::empty;
+    entry.doubled[color] = bitboard::empty;
+    for (bitboard_t b = pawns; b;)
+    {
+      bitboard::square_t square = bitboard::pop_lsb(b);
+      int file = bitboard::file_of(square);
+      int rank = bitboard::rank_of(square);
+      // Pawns never stand on the first or last rank, the shifts stay below 64
+      bitboard_t above = ~bitboard_t(0) << 8 * (rank + 1);
+      bitboard_t below = (bitboard_t(1) << 8 * rank) - 1;
+      bitboard_t ahead = color ? below : above;
+      bitboard_t behind = color ? above : below;
+      bitboard_t file_bb = bitboard::file_a << file;
+      bitboard_t adjacent = (file > 0 ? file_bb >> 1 : 0)
+        | (file < 7 ? file_bb << 1 : 0);
+      bitboard_t square_bb = bitboard::square_bb(square);
+      entry.files[color] |= 1 << file;
+      if (not (pawns & adjacent))
+        entry.isolated[color] |= square_bb;
+      if (pawns & file_bb & behind)
+        entry.doubled[color] |= square_bb;
+      if (not (enemies & (file_bb | adjacent) & ahead))
+      {
+        entry.passed[color] |= square_bb;
+        score += passed_bonus[color ? 7 - rank : rank];
+      }
+    }
+    score -= doubled_malus * bitboard::popcount(entry.doubled[color])
+      + isolated_malus * bitboard::popcount(entry.isolated[color]);
+    entry.score += color ? -score : score;
+
+    // Pawns on the second and third ranks of at least two files of a wing
+    bitboard_t shelter = color ? bitboard::rank_8 >> 8 | bitboard::rank_8 >> 16
+      : bitboard::rank_1 << 8 | bitboard::rank_1 << 16;
+    for (int wing : {PawnTable::QUEEN_SIDE, PawnTable::KING_SIDE})
+    {
+      int files = 0;
+      for (int file = 0; file < 3; ++file)
+        if (pawns & shelter & bitboard::file_a << (wing ? 5 + file : file))
+          ++files;
+      entry.shield[color][wing] = files >= 2 ? shield_bonus : 0;
+    }
   }
-
-  if (pawn_shield_count > 1)
-    return 50;
-  return 0;
 }
 
+// A king on the first two ranks of a wing is sheltered by its pawns there
+int AI::king_shield(const PawnTable::Entry& pawns, plugin::Color color,
+                    plugin::Position king_pos)
+{
+  int file = ~king_pos.file_get();
+  int rank = ~king_pos.rank_get();
+  if (color == plugin::Color::BLACK)
+    rank = 7 - rank;
+  if (rank > 1 or (file > 2 and file < 5))
+    return 0;
+  return pawns.shield[static_cast<bool>(color)][file >= 5
+    ? PawnTable::KING_SIDE : PawnTable::QUEEN_SIDE];
+}
 
 // Coefficients aren't set yet
-int AI::evaluate(const ChessBoard& board)
+int AI::evaluate(Worker& worker)
 {
-  return evaluation_function(board);// / 50;
+  const ChessBoard& board = worker.board;
+  if (network_.is_loaded())
+  {
+    int value = network_.evaluate(worker.accumulator.get(),
+        static_cast<bool>(board.side_to_move_get()));
+    return board.side_to_move_get() == color_ ? value : -value;
+  }
+  PawnTable::Entry& pawns = worker.pawns.entry_get(board.pawn_key_get());
+  ++worker.stats.pawn_probes;
+  if (pawns.key == board.pawn_key_get())
+    ++worker.stats.pawn_hits;
+  else
+    pawn_structure_evaluate(board, pawns);
+  return evaluation_function(board, pawns);// / 50;
   /*int material_bonus_position = board_bonus_position(board);
   return material_bonus_position / 10;*/
 }
 
-int AI::minimax(int depth, plugin::Color playing_color, int A, int B)
+// depth counts the plies from the root, remaining the plies left to search
+// which reductions may take off
+int AI::minimax(Worker& worker, int depth, int remaining,
+                plugin::Color playing_color, int A, int B, bool null_move)
 {
-  const ChessBoard& board = *(temporary_history_board_[depth]);
-  std::vector<std::shared_ptr<Move>> moves = board.get_possible_actions(playing_color);//RuleChecker::possible_moves(board, playing_color);
-  /*struct {
-    bool operator()(std::shared_ptr<Move> m1, std::shared_ptr<Move> m2)
-    {
-      return *m1 < *m2;
-    }
-  } custom;
-  std::sort(moves.begin(), moves.end(), custom);*/
-  if (moves.size() == 0)
+  ChessBoard& board = worker.board;
+  worker.pv_length[depth] = depth;
+  // Nothing to search when the tables know the value
+  Tablebase::Result result;
+  if (depth > 0 and tablebase_.probe(board, result))
   {
-    auto playing_king_position = board.get_king_position(playing_color);
-    if (RuleChecker::isCheck(board, playing_king_position))
-      return -100000 * (max_depth_ - depth + 1);
-    else
-      return 0;
+    ++worker.stats.tb_hits;
+    return tablebase_score(result, depth);
   }
-
-  if (depth >= max_depth_)
+  if (remaining <= 0)
+    return quiescence(worker, depth, A, B);
+  // The first iteration always completes, there has to be a move to play
+  if ((++worker.stats.nodes & (check_interval - 1)) == 0 and worker.id == 0
+      and worker.max_depth > 1 and not pondering_
+      and steady_clock::now() >= hard_deadline_)
+    stop_ = true;
+  if (stop_)
+    return 0;
+  CompactMove hash_move = CompactMove::none();
+  TranspositionTable::Entry entry;
+  ++worker.stats.tt_probes;
+  if (remaining > 0 and tt_.probe(board.key_get(), entry))
+  {
+    ++worker.stats.tt_hits;
+    hash_move = entry.move;
+    int score = score_from_tt(entry.score, depth);
+    // The root always searches, it has to pick a move
+    if (depth > 0 and entry.depth >= remaining
+        and (entry.bound == TranspositionTable::EXACT
+          or (entry.bound == TranspositionTable::LOWER and score >= B)
+          or (entry.bound == TranspositionTable::UPPER and score <= A)))
+      return score;
+  }
+  bool in_check =
+    RuleChecker::isCheck(board, board.get_king_position(playing_color));
+
+  // Null move pruning: if passing the turn still fails high, a move will
+  // too. Not right after another null move, and not in the principal
+  // variation. Zugzwang is likely with only pawns left, the cutoff is then
+  // verified by a shallower search of the node itself.
+  if (null_move and depth > 0 and not in_check and B - A == 1
+      and remaining >= 2 and worker.played[depth - 1] != CompactMove::none())
   {
-    int ret = evaluate(board);
+    int static_value = evaluate(worker);
     if (depth % 2)
-      return -ret;
-    return ret;
+      static_value = -static_value;
+    if (static_value >= B)
+    {
+      int R = reductions_.null_move + (remaining >= 6);
+      ChessBoard::Undo& undo = worker.undo_stack[depth];
+      worker.played[depth] = CompactMove::none();
+      ++worker.stats.null_moves;
+      board.apply_null_move(undo);
+      int value = -minimax(worker, depth + 1, remaining - 1 - R,
+                           !playing_color, -B, -B + 1);
+      board.undo_null_move(undo);
+      if (stop_)
+        return 0;
+      if (value >= B)
+      {
+        bool pieces = board.color_bb(playing_color)
+          & ~board.pieces_bb(playing_color, plugin::PieceType::PAWN)
+          & ~board.pieces_bb(playing_color, plugin::PieceType::KING);
+        if (not pieces)
+          value = minimax(worker, depth, remaining - R, playing_color, B - 1,
+                          B, false);
+        // Mates found without moving are not proven
+        if (value >= B)
+        {
+          ++worker.stats.null_move_cutoffs;
+          return std::abs(value) >= mate_bound ? B : value;
+        }
+      }
+    }
   }
 
-  int best_move_value = -1000000;
+  int original_A = A;
+  // Without some of its moves the root value is not the position's
+  bool excluding = depth == 0 and worker.root_excluded.size();
+  CompactMove best_move = CompactMove::none();
+  CompactMove previous =
+    depth > 0 ? worker.played[depth - 1] : CompactMove::none();
+  CompactMove counter_move = previous == CompactMove::none()
+    ? CompactMove::none()
+    : worker.counter_moves[previous.from_get()][previous.to_get()];
+  MovePicker picker(board, hash_move, worker.killers[depth], counter_move,
+                    worker.history);
+  CompactMove move = picker.next();
+  if (move == CompactMove::none())
+  {
+    if (in_check)
+      return -mate_value + depth;
+    else
+      return 0;
+  }
 
+  int best_move_value = -infinity;
+  int move_count = 0;
+  MoveList quiets_tried;
 
-  for (auto move_ptr : moves)
+  for (; move != CompactMove::none(); move = picker.next())
   {
-    Move& move = *move_ptr;
     //std::cerr << move << std::endl;
     /*if (tmp.board_get() != board.board_get())
     {
@@ -453,19 +728,62 @@ int AI::minimax(int depth, plugin::Color playing_color, int A, int B)
       tmp.pretty_print();
       throw std::invalid_argument("board mismatch");
     }*/
-    ChessBoard tmp = ChessBoard(board);
-    
-    short token = tmp.apply_move(move);
-    temporary_history_board_.push_back(&tmp);
-    if (RuleChecker::three_fold_repetition(permanent_history_board_, temporary_history_board_)) {
-      temporary_history_board_.pop_back();
-        return 0;
+    if (depth == 0 and worker.root_excluded.contains(move))
+      continue;
+    ++move_count;
+    bool quiet = not move.is_capture() and not move.is_promotion();
+    worker.played[depth] = move;
+    ChessBoard::Undo& undo = worker.undo_stack[depth];
+    board.apply_move(move, undo);
+    // Principal variation search: once a move is expected to be the best,
+    // the others are only shown to be worse with a null window. One that is
+    // not gets searched again with the whole window. A move repeating a
+    // position is a draw: the opponent can repeat it again, and the table
+    // may hold a score that does not see the repetition.
+    int move_value;
+    if (board.repetition())
+    {
+      move_value = 0;
+      worker.pv_length[depth + 1] = depth + 1;
+    }
+    else if (move_count == 1)
+      move_value = -minimax(worker, depth + 1, remaining - 1, !playing_color,
+                            -B, -A);
+    else
+    {
+      // Late quiet moves are searched shallower, unless they check or
+      // escape a check. Those that raise alpha get their full depth back.
+      int reduction = 0;
+      if (quiet and remaining >= 3 and move_count > 3 and not in_check
+          and not RuleChecker::isCheck(board,
+                    board.get_king_position(!playing_color)))
+      {
+        reduction = std::min(lmr_table_[std::min(remaining, 63)]
+                                       [std::min(move_count, 63)],
+                             remaining - 2);
+        if (reduction > 0)
+        {
+          ++worker.stats.reduced_moves;
+          worker.stats.reduced_plies += reduction;
+        }
+      }
+      move_value = -minimax(worker, depth + 1, remaining - 1 - reduction,
+                            !playing_color, -A - 1, -A);
+      if (reduction > 0 and move_value > A)
+      {
+        ++worker.stats.reduction_researches;
+        move_value = -minimax(worker, depth + 1, remaining - 1,
+                              !playing_color, -A - 1, -A);
+      }
+      if (A < move_value and move_value < B)
+        move_value = -minimax(worker, depth + 1, remaining - 1,
+                              !playing_color, -B, -A);
     }
-    int move_value = -minimax(depth + 1, !playing_color, -B, -A);
+    board.undo_move(move, undo);
+    if (stop_)
+      return 0;
 
     //Save best move
-    if (depth == 0)
-      std::cerr << "move " << move << "(" << move.priority_ << ") scored " << move_value << std::endl;
     /*if (move_value == best_move_value)
     {
       int rand = std::experimental::randint(1, 100);
@@ -479,61 +797,177 @@ int AI::minimax(int depth, plugin::Color playing_color, int A, int B)
     }
     else*/ if (move_value > best_move_value) {
       best_move_value = move_value;
-      if (depth == 0) {
-        best_move_ = move_ptr;
-        std::cerr << "best_move so far is " << *best_move_ << " score: " << move_value << std::endl;
-      }
+      best_move = move;
+      if (depth == 0)
+        worker.best_move = move;
 
       if (move_value > A) {
         A = move_value;
+        auto& pv = worker.pv[depth];
+        pv[depth] = move;
+        for (int ply = depth + 1; ply < worker.pv_length[depth + 1]; ++ply)
+          pv[ply] = worker.pv[depth + 1][ply];
+        worker.pv_length[depth] = worker.pv_length[depth + 1];
         if (A >= B) {
-          temporary_history_board_.pop_back();
           //std::cerr << "AB pruning" << std::endl;
+          ++worker.stats.cutoffs;
+          if (move_count == 1)
+            ++worker.stats.first_move_cutoffs;
+          if (quiet)
+          {
+            auto& killers = worker.killers[depth];
+            if (move != killers[0])
+              killers = {move, killers[0]};
+            if (previous != CompactMove::none())
+              worker.counter_moves[previous.from_get()][previous.to_get()] =
+                move;
+            int bonus = std::min(remaining * remaining, 400);
+            history_update(worker, playing_color, move, bonus);
+            for (size_t i = 0; i < quiets_tried.size(); ++i)
+              history_update(worker, playing_color, quiets_tried[i], -bonus);
+          }
+          if (not excluding)
+            tt_.store(board.key_get(), remaining, TranspositionTable::LOWER,
+                score_to_tt(best_move_value, depth), move);
           return best_move_value;
         }
       }
 
     }
-    temporary_history_board_.pop_back();
-    //tmp.undo_move(move, token);
+    if (quiet)
+      quiets_tried.push(move);
   }
+  if (not excluding)
+    tt_.store(board.key_get(), remaining, best_move_value > original_A
+        ? TranspositionTable::EXACT : TranspositionTable::UPPER,
+        score_to_tt(best_move_value, depth), best_move);
   //julien est bete ohhhhhhhh! non mais on l'aime notre juju :D
   return best_move_value;
 }
 
-int AI::count_isolated(plugin::Color color)
+// Below the horizon only captures and promotions are searched, so that the
+// evaluation never stops in the middle of an exchange. The side to move may
+// stand pat on the static evaluation unless it is in check.
+int AI::quiescence(Worker& worker, int depth, int A, int B)
 {
-  int count = 0;
-  bool present = false;
-  int meet = 0;
-
-  for (auto j = 0; j < 8; j++)
+  ChessBoard& board = worker.board;
+  if (static_cast<unsigned long>(depth) > worker.stats.seldepth)
+    worker.stats.seldepth = depth;
+  if ((++worker.stats.qnodes & (check_interval - 1)) == 0 and worker.id == 0
+      and worker.max_depth > 1 and not pondering_
+      and steady_clock::now() >= hard_deadline_)
+    stop_ = true;
+  if (stop_)
+    return 0;
+  plugin::Color playing_color = board.side_to_move_get();
+  bool in_check =
+    RuleChecker::isCheck(board, board.get_king_position(playing_color));
+  int stand_pat = -infinity;
+  if (not in_check or depth >= max_ply - 1)
+  {
+    stand_pat = evaluate(worker);
+    if (depth % 2)
+      stand_pat = -stand_pat;
+    if (stand_pat >= B or depth >= max_ply - 1)
+      return stand_pat;
+    A = std::max(A, stand_pat);
+  }
+  int best_value = stand_pat;
+
+  // Every evasion is searched, a check at the horizon may be a mate
+  MovePicker picker = in_check
+    ? MovePicker(board, CompactMove::none(), worker.killers[depth],
+                 CompactMove::none(), worker.history)
+    : MovePicker(board);
+  for (CompactMove move = picker.next(); move != CompactMove::none();
+       move = picker.next())
   {
-    for (auto i = 0; i < 8; i++)
-    { // vertical traversal - not horizontal like we usually do
-      auto piece_type = board_.piecetype_get(plugin::Position(static_cast<plugin::File>(i),
-            static_cast<plugin::Rank>(j)));
-      auto piece_color = board_.color_get(plugin::Position(static_cast<plugin::File>(i),
-            static_cast<plugin::Rank>(j)));
-
-      if (piece_type == plugin::PieceType::PAWN && piece_color == color)
+    if (not in_check and not move.is_promotion()
+        and stand_pat + MovePicker::material_gain(board, move) + delta_margin
+          <= A)
+      continue;
+    ChessBoard::Undo& undo = worker.undo_stack[depth];
+    board.apply_move(move, undo);
+    int value = -quiescence(worker, depth + 1, -B, -A);
+    board.undo_move(move, undo);
+    if (stop_)
+      return 0;
+    if (value > best_value)
+    {
+      best_value = value;
+      if (value > A)
       {
-        if (!present) //first time meeting a pawn
-        {
-          present = true;
-        }
-        meet++;
+        A = value;
+        if (A >= B)
+          break;
       }
     }
+  }
+  if (in_check and best_value == -infinity)
+    return -mate_value + depth;
+  return best_value;
+}
 
-    if (present && !meet)
+// Wins go for the fastest mate, losses for the slowest one
+CompactMove AI::tablebase_move_get()
+{
+  Tablebase::Result result;
+  if (not tablebase_.probe(board_, result))
+    return CompactMove::none();
+  CompactMove best = CompactMove::none();
+  int best_rank = -1000;
+  MoveList moves = RuleChecker::possible_moves(board_, color_);
+  for (size_t i = 0; i < moves.size(); ++i)
+  {
+    ChessBoard::Undo undo;
+    board_.apply_move(moves[i], undo);
+    // A double push giving an en passant capture is not in the tables
+    bool found = tablebase_.probe(board_, result);
+    board_.undo_move(moves[i], undo);
+    if (not found)
+      continue;
+    int rank = 0;
+    if (result.outcome == Tablebase::Result::LOSS)
+      rank = 500 - result.plies;
+    else if (result.outcome == Tablebase::Result::WIN)
+      rank = -500 + result.plies;
+    if (rank > best_rank)
     {
-      present = false;
-      count++;
+      best_rank = rank;
+      best = moves[i];
     }
-    meet = 0;
   }
-  return count;
+  return best;
+}
 
+int AI::tablebase_score(Tablebase::Result result, int depth)
+{
+  int score = tablebase_win - depth - result.plies;
+  switch (result.outcome)
+  {
+    case Tablebase::Result::WIN:
+      return score;
+    case Tablebase::Result::LOSS:
+      return -score;
+    default:
+      return 0;
+  }
 }
 
+int AI::score_to_tt(int score, int depth)
+{
+  if (score >= tablebase_bound)
+    return score + depth;
+  if (score <= -tablebase_bound)
+    return score - depth;
+  return score;
+}
+
+int AI::score_from_tt(int score, int depth)
+{
+  if (score >= tablebase_bound)
+    return score - depth;
+  if (score <= -tablebase_bound)
+    return score + depth;
+  return score;
+}
@@ -5,138 +5,218 @@
 #include "plugin/position.hh"
 #include "chessboard.hh"
 #include "player.hh"
-
+#include "plugin-auxiliary.hh"
+#include "move-picker.hh"
+#include "nnue.hh"
+#include "opening-book.hh"
+#include "pawn-table.hh"
+#include "search-stats.hh"
+#include "tablebase.hh"
+#include "transposition-table.hh"
+
+#include <atomic>
 #include <cmath>
-#include <experimental/optional>
+#include <fstream>
 #include <iomanip>
 #include <memory>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <vector>
 #include <utility>
 
+/* How much the search prunes, in plies */
+struct SearchReductions
+{
+  /* A null move is searched this much shallower than a move, one more ply
+   * from 6 plies left */
+  int null_move = 2;
+  /* The n-th move with d plies left is reduced by
+   * lmr_base + ln(d) * ln(n) / lmr_divisor */
+  double lmr_base = 0.5;
+  double lmr_divisor = 2.5;
+};
+
+/* Settings of the ai binary */
+struct AIOptions
+{
+  size_t hash_megabytes = TranspositionTable::default_megabytes;
+  unsigned threads = 1;
+  SearchReductions reductions;
+  /* Think on the opponent's time */
+  bool ponder = false;
+  /* Best lines searched and reported, each one without the first moves of
+   * the ones before */
+  unsigned multi_pv = 1;
+  /* File a JSON report of each search is appended to, none if empty */
+  std::string json_log;
+  /* Opening book played from without searching, none if empty */
+  std::string book;
+  /* Endgame tables written by tbgen, none if empty */
+  std::string tablebase;
+  /* Network evaluating the positions instead of evaluation_function, none
+   * if empty */
+  std::string network;
+};
+
 class AI : public Player
 {
   public:
     using eval_cell_t = int;
-    AI(plugin::Color ai_color);
+    AI(plugin::Color ai_color, const AIOptions& options = AIOptions());
+    ~AI();
     std::string play_next_move(const std::string& received_move) override;
+    void ponder() override;
     void set_scripted_moves(std::vector<std::shared_ptr<Move>> moves);
 
   private :
-    float estimate_time(int nb_possible_moves, int max_depth = -1);
-    int piece_numbers(const ChessBoard& board, plugin::PieceType type, plugin::Color color);
-
-    int minimax(int depth, plugin::Color playing_color, int A, int B);
-
-    int evaluate(const ChessBoard& board);
+    static constexpr int max_ply = 128;
 
-    int count_isolated(plugin::Color color);
-    int board_bonus_position(const ChessBoard& board);
-    int evaluation_function(const ChessBoard& board);
-    int get_piece_bonus_position(plugin::Color color, plugin::PieceType piece, const plugin::Position& pos);
-
-    const plugin::Color opponent_color_;
-    std::shared_ptr<Move> best_move_;
-    ChessBoard board_;
-    std::vector<std::shared_ptr<Move>> scripted_moves_;
-
-    std::vector<ChessBoard*> temporary_history_board_;
-    std::vector<ChessBoard::board_t> permanent_history_board_;
-
-    int max_depth_ = 3;
-    unsigned int fixed_board_ = 0;
-    double c_ = 5 / std::pow(20, 3);
-
-    int king_zone_attack(plugin::Position king_pos, std::experimental::optional<plugin::PieceType> piece_type, int value_of_attack, int i, int j);
-    int pawn_shield(const ChessBoard& board, plugin::Position king_pos);
- 
-   const std::array<std::array<eval_cell_t, 8>, 8> pawn_weight_board = 
+    /* Everything a search thread writes, each plays its moves on its own copy
+     * of the board. The first worker belongs to the main thread. */
+    struct Worker
     {
-       0, 0, 0, 0, 0, 0, 0, 0,
-       50, 50, 50, 50, 50, 50, 50, 50,
-       10, 10, 20, 30, 30, 20, 10, 10,
-       5, 5, 10, 25, 25, 10, 5, 5,
-       0, 0, 0, 20, 20, 0, 0, 0,
-       5, -5, -10, 0, 0, -10, -5, 5,
-       5, 10, 10, -20, -20, 10, 10, 5,
-       0, 0, 0, 0, 0, 0, 0, 0
+      explicit Worker(unsigned id);
+
+      unsigned id;
+      ChessBoard board;
+      /* Follows board when the network is loaded */
+      nnue::BoardAccumulator accumulator;
+      /* One record per ply */
+      std::array<ChessBoard::Undo, max_ply> undo_stack;
+      /* Quiet moves that last caused a cutoff at each ply */
+      std::array<std::array<CompactMove, 2>, max_ply> killers;
+      /* Move searched at each ply, the counter move table is indexed by the
+       * start and destination of the opponent's last one */
+      std::array<CompactMove, max_ply> played;
+      std::array<std::array<CompactMove, 64>, 64> counter_moves;
+      /* Quiet move scores, raised on cutoffs and lowered for the quiet moves
+       * tried before, kept between moves */
+      MovePicker::history_t history;
+      CompactMove best_move;
+      /* Triangular table of principal variations, the one found at each ply
+       * goes from pv[ply][ply] to pv[ply][pv_length[ply] - 1] */
+      std::array<std::array<CompactMove, max_ply>, max_ply> pv;
+      std::array<int, max_ply> pv_length;
+      /* Root moves left out, the first moves of the better lines in
+       * Multi-PV mode */
+      MoveList root_excluded;
+      int max_depth;
+      SearchStats stats;
+      PawnTable pawns;
     };
 
-    const std::array<std::array<eval_cell_t, 8>, 8> knight_weight_board =
+    struct SearchResult
     {
-       -50, -40, -30, -30, -30, -30, -40, -50,
-       -40, -20, 0, 0, 0, 0, -20, -40,
-       -30, 0, 10, 15, 15, 10, 0, -30,
-       -30, 5, 15, 20, 20, 15, 5, -30,
-       -30, 0, 15, 20, 20, 15, 0, -30,
-       -30, 5, 10, 15, 15, 10, 5, -30,
-       -40, -20, 0, 5, 5, 0, -20, -40,
-       -50, -40, -30, -30, -30, -30, -40, -50
+      CompactMove move;
+      /* Expected reply, the second move of the principal variation */
+      CompactMove reply;
+      int value;
+      /* Of the last completed iteration */
+      SearchReport report;
     };
 
+    void search_prepare();
+    SearchResult search();
+    SearchReport report_get(int score, steady_clock::time_point start) const;
+    void deadlines_set();
+    void history_update(Worker& worker, plugin::Color color, CompactMove move,
+                        int bonus);
+    void helper_search(Worker& worker);
+    int root_search(Worker& worker, int previous_value);
+    int piece_numbers(const ChessBoard& board, plugin::PieceType type, plugin::Color color);
 
-    const std::array<std::array<eval_cell_t, 8>, 8> bishop_weight_board =
-    {
-       -20, -10, -10, -10, -10, -10, -10, -20,
-       -10, 0, 0, 0, 0, 0, 0, -10,
-       -10, 0, 5, 10, 10, 5, 0, -10,
-       -10, 5, 5, 10, 10, 5, 5, -10,
-       -10, 0, 10, 10, 10, 10, 0, -10,
-       -10, 10, 10, 10, 10, 10, 10, -10,
-       -10, 5, 0, 0, 0, 0, 5, -10,
-       -20, -10, -10, -10, -10, -10, -10, -20
-    };
-
-
-    const std::array<std::array<eval_cell_t, 8>, 8> rook_weight_board =
-    {
-       0, 0, 0, 0, 0, 0, 0, 0,
-       5, 10, 10, 10, 10, 10, 10, 5,
-       -5, 0, 0, 0, 0, 0, 0, -5,
-       -5, 0, 0, 0, 0, 0, 0, -5,
-       -5, 0, 0, 0, 0, 0, 0, -5,
-       -5, 0, 0, 0, 0, 0, 0, -5,
-       -5, 0, 0, 0, 0, 0, 0, -5,
-       0, 0, 0, 5, 5, 0, 0, 0
-    };
-
-    const std::array<std::array<eval_cell_t, 8>, 8> queen_weight_board =
-    {
-       -20, -10, -10, -5, -5, -10, -10, -20,
-       -10, 0, 0, 0, 0, 0, 0, -10,
-       -10, 0, 5, 5, 5, 5, 0, -10,
-       -5, 0, 5, 5, 5, 5, 0, -5,
-       0, 0, 5, 5, 5, 5, 0, -10,
-       -10, 5, 5, 5, 5, 5, 0, -10,
-       -10, 0, 5, 0, 0, 0, 0, -10,
-       -20, -10, -10, -5, -5, -10, -10, -20
-    };
+    int minimax(Worker& worker, int depth, int remaining,
+                plugin::Color playing_color, int A, int B,
+                bool null_move = true);
+    int quiescence(Worker& worker, int depth, int A, int B);
+    /* Move keeping the best result the tables give, none if the position
+     * is not in them */
+    CompactMove tablebase_move_get();
+    /* Score of a position from the tables depth plies from the root */
+    static int tablebase_score(Tablebase::Result result, int depth);
+    /* Mate and table scores count plies from the root, the transposition
+     * table keeps them from the node depth plies from it */
+    static int score_to_tt(int score, int depth);
+    static int score_from_tt(int score, int depth);
+
+    int evaluate(Worker& worker);
 
-    const std::array<std::array<eval_cell_t, 8>, 8> king_middle_weight_board =
-    {
-       -30, -40, -40, -50, -50, -40, -40, -30,
-       -30, -40, -40, -50, -50, -40, -40, -30,
-       -30, -40, -40, -50, -50, -40, -40, -30,
-       -30, -40, -40, -50, -50, -40, -40, -30,
-       -20, -30, -30, -40, -40, -30, -30, -20,
-       -10, -20, -20, -20, -20, -20, -20, -10,
-       20, 20, 0, 0, 0, 0, 20, 20,
-       20, 30, 10, 0, 0, 10, 30, 20
-    };
+    int board_bonus_position(const ChessBoard& board);
+    int evaluation_function(const ChessBoard& board,
+                            const PawnTable::Entry& pawns);
+    static void pawn_structure_evaluate(const ChessBoard& board,
+                                        PawnTable::Entry& entry);
+    static int king_shield(const PawnTable::Entry& pawns, plugin::Color color,
+                           plugin::Position king_pos);
+    static int distance_sum(int coord);
 
-    const std::array<std::array<eval_cell_t, 8>, 8> king_end_weight_board =
-    {
-       -50, -40, -30, -20, -20, -30, -40, -50,
-       -30, -20, -10, 0, 0, -10, -20, -30,
-       -30, -10, 20, 30, 30, 20, -10, -30,
-       -30, -10, 30, 40, 40, 30, -10, -30,
-       -30, -10, 30, 40, 40, 30, -10, -30,
-       -30, -10, 20, 30, 30, 20, -10, -30,
-       -30, -30, 0, 0, 0, 0, -30, -30,
-       -50, -30, -30, -30, -30, -30, -30, -50
-    };
+    const plugin::Color opponent_color_;
+    CompactMove best_move_;
+    ChessBoard board_;
+    std::vector<std::shared_ptr<Move>> scripted_moves_;
 
-    const std::array<std::array<eval_cell_t, 8>, 8> center_manhattan_distance =
+    /* Lazy SMP: helper threads search the same root, they only help the
+     * main thread through the transposition table */
+    std::vector<std::unique_ptr<Worker>> workers_;
+    /* Kept between moves, entries of previous searches age */
+    TranspositionTable tt_;
+    static constexpr int history_max = 16384;
+    const SearchReductions reductions_;
+    /* Lines the main thread searches at each depth, the helpers search one */
+    const unsigned multi_pv_;
+    /* Late move reductions by plies left and move number */
+    std::array<std::array<int, 64>, 64> lmr_table_;
+    /* Bound of the root window, beyond every score */
+    static constexpr int infinity = 10000000;
+    /* Half width of the first root window around the previous score */
+    static constexpr int aspiration_window = 50;
+
+    /* Seconds left on the game clock, the main thread reads the clock every
+     * check_interval nodes */
+    double time_left_;
+    static constexpr unsigned check_interval = 2048;
+    steady_clock::time_point soft_deadline_;
+    steady_clock::time_point hard_deadline_;
+    std::atomic<bool> stop_;
+
+    /* While pondering the search has no deadline, play_next_move sets them
+     * on a ponder hit */
+    const bool ponder_;
+    std::atomic<bool> pondering_;
+    CompactMove ponder_move_;
+    std::thread ponder_thread_;
+    SearchResult ponder_result_;
+    std::ofstream json_log_;
+    /* Probed before each search */
+    OpeningBook book_;
+    std::mt19937 random_;
+    /* Probed at the root and in the search, a won position from the tables
+     * scores below a mate the search sees */
+    Tablebase tablebase_;
+    static constexpr int tablebase_win = 99999;
+    /* Scores beyond it are mates or wins from the tables */
+    static constexpr int tablebase_bound = tablebase_win - 1000;
+    /* The workers keep its accumulators when loaded */
+    nnue::Network network_;
+    /* A capture that cannot bring the score back above alpha with this much
+     * to spare is not searched */
+    static constexpr int delta_margin = 200;
+
+    /* Attacks of the opponent on the king of color and the squares around
+     * it, each worth king_zone_weight with every piece on the board */
+    static int king_zone_attacks(const ChessBoard& board, plugin::Color color);
+    static constexpr int king_zone_weight = 8;
+    /* Pawn structure terms, cached in the pawn tables */
+    static constexpr int doubled_malus = 50;
+    static constexpr int isolated_malus = 20;
+    static constexpr int shield_bonus = 50;
+    /* By rank from the side of the pawn */
+    static constexpr std::array<int, 8> passed_bonus =
+      {{0, 10, 10, 20, 35, 60, 100, 0}};
+
+    /* The piece-square tables are in piece-square.hh, the board sums them */
+    static constexpr std::array<std::array<eval_cell_t, 8>, 8> center_manhattan_distance =
     {
       6, 5, 4, 3, 3, 4, 5, 6,
       5, 4, 3, 2 ,2, 3, 4, 5,
@@ -148,9 +228,4 @@ class AI : public Player
       6, 5, 4, 3, 3, 4, 5, 6
     };
 
-    const std::array<eval_cell_t, 7> attack_weight =
-    {
-      0, 50, 75, 88, 94, 97, 99 // King Safety wikiprog
-    };
-
 };
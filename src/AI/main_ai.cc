@@ -1,15 +1,64 @@
+#include "boost/program_options.hpp"
 #include "../client.hh"
 #include "AI.hh"
+namespace po = boost::program_options;
 
 int main(int argc, char* argv[])
 {
-  argc = argc;
-  std::string ip(argv[1]);
-  std::string port(argv[2]);
-  std::string pgn_path;
-  if (argv[3] != nullptr)
-    pgn_path = std::string(argv[3]);
-
-  Client<AI> client(ip, port, pgn_path);
-  return client.start();
+  AIOptions options;
+  SearchReductions& reductions = options.reductions;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "show usage")
+    ("ip", po::value<std::string>(), "address of the engine")
+    ("port", po::value<std::string>(), "port of the engine")
+    ("pgn", po::value<std::string>()->default_value(""),
+     "PGN file of the moves to play first")
+    ("hash", po::value(&options.hash_megabytes)->default_value(
+        options.hash_megabytes),
+     "transposition table size in megabytes")
+    ("threads", po::value(&options.threads)->default_value(options.threads),
+     "number of search threads")
+    ("null-move-reduction",
+     po::value(&reductions.null_move)->default_value(reductions.null_move),
+     "plies a null move search is shallower than a move search")
+    ("lmr-base",
+     po::value(&reductions.lmr_base)->default_value(reductions.lmr_base),
+     "late move reduction of every late move")
+    ("lmr-divisor",
+     po::value(&reductions.lmr_divisor)->default_value(reductions.lmr_divisor),
+     "late move reductions grow with ln(depth) * ln(move number) / divisor")
+    ("ponder", po::bool_switch(&options.ponder),
+     "think on the opponent's time")
+    ("multipv",
+     po::value(&options.multi_pv)->default_value(options.multi_pv),
+     "best lines to search and report")
+    ("json-log", po::value(&options.json_log),
+     "file to append a JSON line of search statistics to for each move")
+    ("book", po::value(&options.book),
+     "opening book to play from, as written by bookgen")
+    ("tablebase", po::value(&options.tablebase),
+     "endgame tables to play from, as written by tbgen")
+    ("network", po::value(&options.network),
+     "neural network to evaluate positions with instead of the handcrafted"
+     " evaluation");
+  // Still usable as ai <ip> <port> [pgn]
+  po::positional_options_description positional;
+  positional.add("ip", 1).add("port", 1).add("pgn", 1);
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc)
+            .positional(positional).run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help") or not vm.count("ip") or not vm.count("port"))
+  {
+    std::cout << "Usage: " << argv[0] << " <ip> <port> [pgn]" << std::endl
+              << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+
+  Client<AI> client(vm["ip"].as<std::string>(), vm["port"].as<std::string>(),
+                    vm["pgn"].as<std::string>());
+  return client.start(options);
 }
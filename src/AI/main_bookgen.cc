@@ -0,0 +1,119 @@
+#include "boost/program_options.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include "opening-book.hh"
+#include "parser.hh"
+namespace po = boost::program_options;
+
+/* Builds an opening book from the first moves of PGN games, the weight of a
+ * move being the number of games that played it */
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "show usage")
+    ("output,o", po::value<std::string>()->default_value("book.bin"),
+     "book file to write")
+    ("plies,p", po::value<int>()->default_value(24),
+     "moves of each game to keep, in plies")
+    ("probe", po::value<std::vector<std::string>>(),
+     "positions, as FEN, whose moves are read back from the written book")
+    ("pgn", po::value<std::vector<std::string>>(), "games, one per file");
+  po::positional_options_description positional;
+  positional.add("pgn", -1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+              .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 2;
+  }
+  if (vm.count("help") or not vm.count("pgn"))
+  {
+    std::cout << "Usage: " << argv[0] << " [-o book.bin] <pgn>..." << std::endl
+              << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+
+  int plies = vm["plies"].as<int>();
+  std::map<std::pair<OpeningBook::key_t, uint16_t>, unsigned> counts;
+  for (const auto& path : vm["pgn"].as<std::vector<std::string>>())
+  {
+    ChessBoard board;
+    try
+    {
+      auto moves = Parser(path).parse();
+      for (int ply = 0; ply < plies and ply < static_cast<int>(moves.size());
+           ++ply)
+      {
+        CompactMove move = board.compact_get(*moves[ply]);
+        if (not board.is_pseudo_legal(move) or not board.is_legal(move))
+        {
+          std::cerr << path << ": illegal move " << *moves[ply] << std::endl;
+          break;
+        }
+        ++counts[{board.key_get(), move.data_get()}];
+        board.apply_move(move);
+      }
+    }
+    catch (const std::invalid_argument& e)
+    {
+      std::cerr << path << ": " << e.what() << std::endl;
+    }
+  }
+
+  std::vector<OpeningBook::Entry> entries;
+  for (const auto& count : counts)
+  {
+    uint16_t move = count.first.second;
+    entries.push_back({count.first.first,
+                       CompactMove(move & 0x3F, (move >> 6) & 0x3F, move >> 12),
+                       static_cast<uint16_t>(std::min(count.second, 0xFFFFu))});
+  }
+  std::string output = vm["output"].as<std::string>();
+  try
+  {
+    OpeningBook::save(output, entries);
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << entries.size() << " moves written to " << output << std::endl;
+
+  if (not vm.count("probe"))
+    return 0;
+  OpeningBook book;
+  if (not book.open(output))
+  {
+    std::cerr << "Cannot open the book " << output << std::endl;
+    return 1;
+  }
+  for (const auto& fen : vm["probe"].as<std::vector<std::string>>())
+  {
+    std::cout << fen << ":";
+    try
+    {
+      for (const auto& entry : book.moves_get(ChessBoard(fen)))
+        std::cout << " " << entry.move << " (" << entry.weight << ")";
+    }
+    catch (const std::invalid_argument& e)
+    {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include "boost/program_options.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "tablebase-generator.hh"
+#include "plugin-auxiliary.hh"
+namespace po = boost::program_options;
+
+/* Generates the endgame tables with up to --pieces pieces, the tables of a
+ * batch on several threads */
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "show usage")
+    ("output,o", po::value<std::string>()->default_value("tablebase.bin"),
+     "tablebase file to write")
+    ("pieces,p", po::value<int>()->default_value(Tablebase::max_pieces),
+     "most pieces on the board, kings included")
+    ("threads,t", po::value<unsigned>()->default_value(
+        std::max(std::thread::hardware_concurrency(), 1u)),
+     "tables generated at once");
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 2;
+  }
+  if (vm.count("help"))
+  {
+    std::cout << desc << "\n";
+    return 0;
+  }
+  int pieces = vm["pieces"].as<int>();
+  if (pieces < 3 or pieces > Tablebase::max_pieces)
+  {
+    std::cerr << "Tables have 3 to " << Tablebase::max_pieces << " pieces"
+              << std::endl;
+    return 2;
+  }
+  unsigned threads = std::max(vm["threads"].as<unsigned>(), 1u);
+
+  tablebase_generator::tables_t tables;
+  std::mutex output_mutex;
+  for (const auto& batch : tablebase_generator::schedule(pieces))
+  {
+    std::vector<std::vector<uint8_t>> results(batch.size());
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+      for (size_t i = next++; i < batch.size(); i = next++)
+      {
+        double time = 0;
+        {
+          scoped_timer timer(time);
+          results[i] = tablebase_generator::generate(batch[i], tables);
+        }
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << batch[i] << ": " << results[i].size() << " positions in "
+                  << time << "s" << std::endl;
+      }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < std::min<size_t>(threads, batch.size()); ++i)
+      workers.emplace_back(work);
+    work();
+    for (auto& worker : workers)
+      worker.join();
+    for (size_t i = 0; i < batch.size(); ++i)
+      tables[batch[i]] = std::move(results[i]);
+  }
+
+  std::string output = vm["output"].as<std::string>();
+  try
+  {
+    Tablebase::save(output, tables);
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << tables.size() << " tables written to " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "move-picker.hh"
+
+namespace
+{
+  // Indexed by auxiliary::PieceTypeToInt, the king never is a victim and
+  // always is the cheapest attacker since its captures are safe
+  const int piece_values[6] = {0, 900, 500, 300, 300, 100};
+}
+
+MovePicker::MovePicker(const ChessBoard& board, CompactMove hash_move,
+                       const killers_t& killers, CompactMove counter_move,
+                       const history_t& history)
+  : board_(board)
+  , hash_move_(hash_move)
+  , killers_(killers)
+  , counter_move_(counter_move)
+  , history_(&history)
+{}
+
+MovePicker::MovePicker(const ChessBoard& board)
+  : board_(board)
+  , hash_move_(CompactMove::none())
+  , killers_({CompactMove::none(), CompactMove::none()})
+  , counter_move_(CompactMove::none())
+  , history_(nullptr)
+  , captures_only_(true)
+{}
+
+CompactMove MovePicker::next()
+{
+  switch (stage_)
+  {
+    case Stage::HASH_MOVE:
+      stage_ = Stage::GENERATE_CAPTURES;
+      if (board_.is_pseudo_legal(hash_move_) and board_.is_legal(hash_move_))
+        return hash_move_;
+      hash_move_ = CompactMove::none();
+      // fallthrough
+    case Stage::GENERATE_CAPTURES:
+      board_.generate_moves(board_.side_to_move_get(), moves_,
+                            ChessBoard::GenType::CAPTURES);
+      for (size_t i = 0; i < moves_.size(); ++i)
+        scores_[i] = mvv_lva(moves_[i]);
+      current_ = 0;
+      stage_ = Stage::CAPTURES;
+      // fallthrough
+    case Stage::CAPTURES:
+      while (current_ < moves_.size())
+      {
+        CompactMove move = pick_best();
+        if (move != hash_move_)
+          return move;
+      }
+      if (captures_only_)
+      {
+        stage_ = Stage::DONE;
+        break;
+      }
+      stage_ = Stage::KILLERS;
+      current_ = 0;
+      // fallthrough
+    case Stage::KILLERS:
+      while (current_ < killers_.size())
+      {
+        CompactMove move = killers_[current_++];
+        if (is_valid(move))
+          return move;
+      }
+      stage_ = Stage::COUNTER_MOVE;
+      // fallthrough
+    case Stage::COUNTER_MOVE:
+      stage_ = Stage::GENERATE_QUIETS;
+      if (counter_move_ != killers_[0] and counter_move_ != killers_[1]
+          and is_valid(counter_move_))
+        return counter_move_;
+      counter_move_ = CompactMove::none();
+      // fallthrough
+    case Stage::GENERATE_QUIETS:
+    {
+      moves_.clear();
+      bool color = static_cast<bool>(board_.side_to_move_get());
+      board_.generate_moves(board_.side_to_move_get(), moves_,
+                            ChessBoard::GenType::QUIETS);
+      for (size_t i = 0; i < moves_.size(); ++i)
+        scores_[i] = (*history_)[color][moves_[i].from_get()][moves_[i].to_get()];
+      current_ = 0;
+      stage_ = Stage::QUIETS;
+    }
+      // fallthrough
+    case Stage::QUIETS:
+      while (current_ < moves_.size())
+      {
+        CompactMove move = pick_best();
+        if (move != hash_move_ and move != killers_[0] and move != killers_[1]
+            and move != counter_move_)
+          return move;
+      }
+      stage_ = Stage::DONE;
+      // fallthrough
+    case Stage::DONE:
+      break;
+  }
+  return CompactMove::none();
+}
+
+// Killers come from sibling nodes, they may not even be legal here
+bool MovePicker::is_valid(CompactMove move) const
+{
+  return move != hash_move_ and not move.is_capture() and not move.is_promotion()
+    and board_.is_pseudo_legal(move) and board_.is_legal(move);
+}
+
+int MovePicker::material_gain(const ChessBoard& board, CompactMove move)
+{
+  int gain = 0;
+  if (move.flags_get() == CompactMove::EN_PASSANT)
+    gain = piece_values[5];
+  else if (move.is_capture())
+    gain = piece_values[board.get_square(bitboard::position_of(move.to_get()))
+                        & 0b00000111];
+  if (move.is_promotion())
+    gain += piece_values[static_cast<int>(move.promotion_piecetype_get())]
+      - piece_values[5];
+  return gain;
+}
+
+int MovePicker::mvv_lva(CompactMove move) const
+{
+  int attacker = board_.get_square(bitboard::position_of(move.from_get()))
+    & 0b00000111;
+  return 8 * material_gain(board_, move) - piece_values[attacker];
+}
+
+// Selection sort step, most nodes only look at a few moves of a stage
+CompactMove MovePicker::pick_best()
+{
+  size_t best = current_;
+  for (size_t i = current_ + 1; i < moves_.size(); ++i)
+    if (scores_[i] > scores_[best])
+      best = i;
+  std::swap(moves_[current_], moves_[best]);
+  std::swap(scores_[current_], scores_[best]);
+  return moves_[current_++];
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "chessboard.hh"
+#include "move-list.hh"
+#include <array>
+
+/*
+** Yields the legal moves of the side to move one at a time, best guesses
+** first: the hash move, captures by most valuable victim then least
+** valuable attacker, the killer moves, the counter move to the previous
+** move, then the remaining quiet moves by history score.
+**
+** A stage is only generated once the previous one is exhausted, so a node
+** that cuts off on an early move never generates its quiet moves.
+**
+** The quiescence search only asks for the captures.
+*/
+class MovePicker
+{
+public:
+  using killers_t = std::array<CompactMove, 2>;
+  /* Butterfly table of quiet move scores, by color, start and destination */
+  using history_t = std::array<std::array<std::array<int, 64>, 64>, 2>;
+
+  MovePicker(const ChessBoard& board, CompactMove hash_move,
+             const killers_t& killers, CompactMove counter_move,
+             const history_t& history);
+  /* Captures and promotions only, by most valuable victim */
+  explicit MovePicker(const ChessBoard& board);
+
+  /* Material a capture or promotion wins, nothing for a quiet move */
+  static int material_gain(const ChessBoard& board, CompactMove move);
+
+  /* Next move to search, CompactMove::none() once every move was given */
+  CompactMove next();
+
+private:
+  enum class Stage
+  {
+    HASH_MOVE,
+    GENERATE_CAPTURES,
+    CAPTURES,
+    KILLERS,
+    COUNTER_MOVE,
+    GENERATE_QUIETS,
+    QUIETS,
+    DONE
+  };
+
+  bool is_valid(CompactMove move) const;
+  int mvv_lva(CompactMove move) const;
+  CompactMove pick_best();
+
+  const ChessBoard& board_;
+  CompactMove hash_move_;
+  killers_t killers_;
+  CompactMove counter_move_;
+  const history_t* history_;
+  bool captures_only_ = false;
+  Stage stage_ = Stage::HASH_MOVE;
+  MoveList moves_;
+  std::array<int, MoveList::capacity> scores_;
+  size_t current_ = 0;
+};
@@ -0,0 +1,144 @@
+#include "opening-book.hh"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t OpeningBook::entry_size;
+
+namespace
+{
+  uint64_t read_big_endian(const unsigned char* bytes, int size)
+  {
+    uint64_t value = 0;
+    for (int i = 0; i < size; ++i)
+      value = value << 8 | bytes[i];
+    return value;
+  }
+
+  void write_big_endian(std::ostream& out, uint64_t value, int size)
+  {
+    for (int i = size - 1; i >= 0; --i)
+      out.put(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+OpeningBook::~OpeningBook()
+{
+  close();
+}
+
+bool OpeningBook::open(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat status;
+  if (fstat(fd, &status) < 0 or status.st_size == 0
+      or status.st_size % entry_size != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  // The mapping stays valid once the descriptor is closed
+  void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  data_ = static_cast<const unsigned char*>(data);
+  size_ = status.st_size / entry_size;
+  return true;
+}
+
+void OpeningBook::close()
+{
+  if (data_)
+    munmap(const_cast<unsigned char*>(data_), size_ * entry_size);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+OpeningBook::Entry OpeningBook::entry_get(size_t index) const
+{
+  const unsigned char* bytes = data_ + index * entry_size;
+  Entry entry;
+  entry.key = read_big_endian(bytes, 8);
+  uint16_t move = read_big_endian(bytes + 8, 2);
+  entry.move = CompactMove(move & 0x3F, (move >> 6) & 0x3F, move >> 12);
+  entry.weight = read_big_endian(bytes + 10, 2);
+  return entry;
+}
+
+std::vector<OpeningBook::Entry>
+OpeningBook::moves_get(const ChessBoard& board) const
+{
+  std::vector<Entry> moves;
+  key_t key = board.key_get();
+  // First entry of the key
+  size_t low = 0;
+  size_t high = size_;
+  while (low < high)
+  {
+    size_t middle = low + (high - low) / 2;
+    if (entry_get(middle).key < key)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  // A key collision or a corrupted file must not make us play nonsense
+  for (; low < size_; ++low)
+  {
+    Entry entry = entry_get(low);
+    if (entry.key != key)
+      break;
+    if (entry.weight != 0 and board.is_pseudo_legal(entry.move)
+        and board.is_legal(entry.move))
+      moves.push_back(entry);
+  }
+  return moves;
+}
+
+CompactMove OpeningBook::probe(const ChessBoard& board,
+                               std::mt19937& random) const
+{
+  auto moves = moves_get(board);
+  unsigned total = 0;
+  for (const auto& entry : moves)
+    total += entry.weight;
+  if (total == 0)
+    return CompactMove::none();
+  unsigned pick = std::uniform_int_distribution<unsigned>(0, total - 1)(random);
+  for (const auto& entry : moves)
+  {
+    if (pick < entry.weight)
+      return entry.move;
+    pick -= entry.weight;
+  }
+  return CompactMove::none();
+}
+
+void OpeningBook::save(const std::string& path, std::vector<Entry> entries)
+{
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) {
+              if (a.key != b.key)
+                return a.key < b.key;
+              return a.weight > b.weight;
+            });
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (not out)
+    throw std::runtime_error("Cannot write the book " + path);
+  for (const auto& entry : entries)
+  {
+    write_big_endian(out, entry.key, 8);
+    write_big_endian(out, entry.move.data_get(), 2);
+    write_big_endian(out, entry.weight, 2);
+    write_big_endian(out, 0, 4);
+  }
+  if (not out)
+    throw std::runtime_error("Cannot write the book " + path);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "chessboard.hh"
+#include "compact-move.hh"
+#include "zobrist.hh"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+** Opening book, a file of moves to play by position.
+**
+** The file is laid out like a Polyglot book: 16 bytes entries, big endian,
+** sorted by key, of a position key, a move, a weight and a learn field left
+** to zero. Keys are the engine's Zobrist keys and moves are CompactMoves,
+** so books are made from PGN files by bookgen rather than taken from other
+** engines.
+**
+** The file is mapped in memory and never read as a whole: a lookup is a
+** binary search touching a few pages.
+*/
+class OpeningBook
+{
+public:
+  using key_t = zobrist::key_t;
+
+  struct Entry
+  {
+    key_t key;
+    CompactMove move;
+    /* Relative odds of playing the move in this position */
+    uint16_t weight;
+  };
+
+  static constexpr size_t entry_size = 16;
+
+  OpeningBook() = default;
+  OpeningBook(const OpeningBook&) = delete;
+  OpeningBook& operator=(const OpeningBook&) = delete;
+  ~OpeningBook();
+
+  /* Maps the book at path, returns false if it cannot be read */
+  bool open(const std::string& path);
+  void close();
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+  /* Book moves of the position, legal on board */
+  std::vector<Entry> moves_get(const ChessBoard& board) const;
+  /* A book move drawn with odds proportional to the weights, none when the
+   * position is not in the book */
+  CompactMove probe(const ChessBoard& board, std::mt19937& random) const;
+
+  /* Sorts the entries and writes them at path, throws std::runtime_error on
+   * failure */
+  static void save(const std::string& path, std::vector<Entry> entries);
+
+private:
+  Entry entry_get(size_t index) const;
+
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+};
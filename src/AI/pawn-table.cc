@@ -0,0 +1,19 @@
+#include "pawn-table.hh"
+#include <algorithm>
+
+constexpr size_t PawnTable::default_entries;
+
+// Rounds down to a power of two number of entries, at least one
+PawnTable::PawnTable(size_t entries)
+{
+  size_t count = 1;
+  while (2 * count <= entries)
+    count *= 2;
+  entries_.resize(count);
+  clear();
+}
+
+void PawnTable::clear()
+{
+  std::fill(entries_.begin(), entries_.end(), Entry());
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "bitboard.hh"
+#include "zobrist.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+** Pawn structure evaluations, indexed by the key of the pawns alone.
+**
+** Pawns rarely move in a search tree, most positions share their structure
+** with many others. Each search thread owns a table, so there is no
+** sharing to care about: the key selects one entry, overwritten on a miss.
+** The zeroed entries are those of the positions without pawns, key 0.
+*/
+class PawnTable
+{
+public:
+  using key_t = zobrist::key_t;
+  using bitboard_t = bitboard::bitboard_t;
+
+  /* Wings a king can shelter on, files a-c and f-h */
+  enum Wing
+  {
+    QUEEN_SIDE,
+    KING_SIDE
+  };
+
+  /* Sets and scores per color */
+  struct Entry
+  {
+    key_t key;
+    /* Doubled, isolated and passed pawns, for white */
+    int32_t score;
+    /* Bit n set when file n holds a pawn */
+    std::array<uint8_t, 2> files;
+    std::array<bitboard_t, 2> passed;
+    std::array<bitboard_t, 2> isolated;
+    /* Pawns with another one of their color behind them */
+    std::array<bitboard_t, 2> doubled;
+    /* Bonus of a king behind the pawns of a wing */
+    std::array<std::array<int16_t, 2>, 2> shield;
+  };
+
+  static constexpr size_t default_entries = 1 << 14;
+
+  explicit PawnTable(size_t entries = default_entries);
+
+  void clear();
+  /* Entry of key if the table holds it, else the one to overwrite with it */
+  Entry& entry_get(key_t key) {
+    return entries_[key & (entries_.size() - 1)];
+  }
+
+private:
+  std::vector<Entry> entries_;
+};
@@ -0,0 +1,125 @@
+#include "search-stats.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+void SearchStats::clear()
+{
+  *this = SearchStats();
+}
+
+SearchStats& SearchStats::operator+=(const SearchStats& other)
+{
+  nodes += other.nodes;
+  qnodes += other.qnodes;
+  if (other.seldepth > seldepth)
+    seldepth = other.seldepth;
+  cutoffs += other.cutoffs;
+  first_move_cutoffs += other.first_move_cutoffs;
+  tt_probes += other.tt_probes;
+  tt_hits += other.tt_hits;
+  null_moves += other.null_moves;
+  null_move_cutoffs += other.null_move_cutoffs;
+  reduced_moves += other.reduced_moves;
+  reduced_plies += other.reduced_plies;
+  reduction_researches += other.reduction_researches;
+  tb_hits += other.tb_hits;
+  pawn_probes += other.pawn_probes;
+  pawn_hits += other.pawn_hits;
+  return *this;
+}
+
+unsigned long SearchStats::total_nodes() const
+{
+  return nodes + qnodes;
+}
+
+double SearchStats::first_move_cutoff_rate() const
+{
+  return cutoffs ? double(first_move_cutoffs) / cutoffs : 0;
+}
+
+double SearchStats::tt_hit_rate() const
+{
+  return tt_probes ? double(tt_hits) / tt_probes : 0;
+}
+
+double SearchStats::pawn_hit_rate() const
+{
+  return pawn_probes ? double(pawn_hits) / pawn_probes : 0;
+}
+
+unsigned long SearchReport::nps() const
+{
+  return seconds > 0 ? stats.total_nodes() / seconds : 0;
+}
+
+SearchReport SearchReport::line_get(size_t n) const
+{
+  SearchReport report = *this;
+  report.score = lines[n].score;
+  report.pv = lines[n].moves;
+  report.multipv = n + 1;
+  return report;
+}
+
+std::string SearchReport::uci_info() const
+{
+  std::ostringstream line;
+  line << "info depth " << depth << " seldepth " << stats.seldepth;
+  if (multipv)
+    line << " multipv " << multipv;
+  line << " score ";
+  if (std::abs(score) >= mate_bound)
+  {
+    int plies = mate_value - std::abs(score);
+    line << "mate " << (score > 0 ? 1 : -1) * ((plies + 1) / 2);
+  }
+  else
+    line << "cp " << score;
+  line << " nodes " << stats.total_nodes() << " nps " << nps()
+       << " hashfull " << hashfull << " tbhits " << stats.tb_hits
+       << " time " << long(seconds * 1000)
+       << " pv";
+  for (auto move : pv)
+    line << " " << move;
+  return line.str();
+}
+
+std::string SearchReport::json(CompactMove played) const
+{
+  std::ostringstream line;
+  line << "{\"move\":\"" << played << "\",\"depth\":" << depth
+       << ",\"seldepth\":" << stats.seldepth << ",\"score\":" << score
+       << ",\"time_ms\":" << long(seconds * 1000)
+       << ",\"nodes\":" << stats.nodes << ",\"qnodes\":" << stats.qnodes
+       << ",\"nps\":" << nps() << ",\"hashfull\":" << hashfull
+       << ",\"tt_hit_rate\":" << stats.tt_hit_rate()
+       << ",\"first_move_cutoff_rate\":" << stats.first_move_cutoff_rate()
+       << ",\"null_moves\":" << stats.null_moves
+       << ",\"null_move_cutoffs\":" << stats.null_move_cutoffs
+       << ",\"reduced_moves\":" << stats.reduced_moves
+       << ",\"reduced_plies\":" << stats.reduced_plies
+       << ",\"reduction_researches\":" << stats.reduction_researches
+       << ",\"tb_hits\":" << stats.tb_hits
+       << ",\"pawn_hit_rate\":" << stats.pawn_hit_rate()
+       << ",\"pv\":[";
+  for (size_t i = 0; i < pv.size(); ++i)
+    line << (i ? ",\"" : "\"") << pv[i] << "\"";
+  line << "]";
+  if (not lines.empty())
+  {
+    line << ",\"lines\":[";
+    for (size_t n = 0; n < lines.size(); ++n)
+    {
+      line << (n ? "," : "") << "{\"score\":" << lines[n].score
+           << ",\"pv\":[";
+      for (size_t i = 0; i < lines[n].moves.size(); ++i)
+        line << (i ? ",\"" : "\"") << lines[n].moves[i] << "\"";
+      line << "]}";
+    }
+    line << "]";
+  }
+  line << "}";
+  return line.str();
+}
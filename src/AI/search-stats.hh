@@ -0,0 +1,114 @@
+#pragma once
+
+#include "compact-move.hh"
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+** Search statistics.
+**
+** Every search thread counts in its own SearchStats. The main thread reads
+** and sums the counters of all the threads at the end of each iteration,
+** while they still run, so a counter is an atomic that only its thread
+** writes: a plain load and store, no locked increment.
+*/
+class Counter
+{
+public:
+  Counter(unsigned long value = 0)
+    : value_(value)
+  {}
+  Counter(const Counter& other)
+    : value_(other)
+  {}
+
+  Counter& operator=(const Counter& other) {
+    return *this = static_cast<unsigned long>(other);
+  }
+  Counter& operator=(unsigned long value) {
+    value_.store(value, std::memory_order_relaxed);
+    return *this;
+  }
+  Counter& operator+=(unsigned long n) {
+    return *this = *this + n;
+  }
+  Counter& operator++() {
+    return *this += 1;
+  }
+  operator unsigned long() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<unsigned long> value_;
+};
+
+struct SearchStats
+{
+  Counter nodes;
+  Counter qnodes;
+  /* Deepest ply reached, quiescence included */
+  Counter seldepth;
+  Counter cutoffs;
+  Counter first_move_cutoffs;
+  Counter tt_probes;
+  Counter tt_hits;
+  Counter null_moves;
+  Counter null_move_cutoffs;
+  Counter reduced_moves;
+  Counter reduced_plies;
+  Counter reduction_researches;
+  Counter tb_hits;
+  Counter pawn_probes;
+  Counter pawn_hits;
+
+  void clear();
+  /* Sums the counters, keeps the largest seldepth */
+  SearchStats& operator+=(const SearchStats& other);
+
+  unsigned long total_nodes() const;
+  /* Shares in [0, 1], 0 when nothing was counted */
+  double first_move_cutoff_rate() const;
+  double tt_hit_rate() const;
+  double pawn_hit_rate() const;
+};
+
+/* A side mated n plies from the root scores n - mate_value, any score
+ * beyond mate_bound is a mate */
+constexpr int mate_value = 1000000;
+constexpr int mate_bound = mate_value - 1000;
+
+/* One of the best lines of a Multi-PV search */
+struct PrincipalVariation
+{
+  int score;
+  std::vector<CompactMove> moves;
+};
+
+/* State of the search after an iteration of the main thread */
+struct SearchReport
+{
+  int depth = 0;
+  /* Centipawns for the side to move, mates are beyond mate_bound */
+  int score = 0;
+  double seconds = 0;
+  /* Permille of the transposition table used by this search */
+  int hashfull = 0;
+  std::vector<CompactMove> pv;
+  SearchStats stats;
+  /* In Multi-PV mode, every line from the best, score and pv being the
+   * first one's. Empty otherwise. */
+  std::vector<PrincipalVariation> lines;
+  /* Rank of the line from 1 in Multi-PV mode, 0 otherwise */
+  int multipv = 0;
+
+  unsigned long nps() const;
+  /* Report showing line n as its principal variation */
+  SearchReport line_get(size_t n) const;
+  /* info depth 12 seldepth 23 [multipv 2] score cp 35 nodes ... pv e2e4
+   * e7e5 */
+  std::string uci_info() const;
+  /* One JSON object on a single line, played being the move sent */
+  std::string json(CompactMove played) const;
+};
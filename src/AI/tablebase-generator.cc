@@ -0,0 +1,559 @@
+#include "tablebase-generator.hh"
+#include "attacks.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+
+namespace tablebase_generator
+{
+  namespace
+  {
+    using square_t = Tablebase::square_t;
+    using squares_t = std::array<square_t, Tablebase::max_pieces>;
+    using bitboard::bitboard_t;
+
+    const char types[] = "QRBNP";
+    const uint8_t invalid = 0xFF;
+    const uint8_t none = 0xFF;
+
+    // The better of two results for the side to move
+    Tablebase::Result better(Tablebase::Result a, Tablebase::Result b)
+    {
+      auto rank = [](Tablebase::Result result) {
+        if (result.outcome == Tablebase::Result::WIN)
+          return 1000 - result.plies;
+        if (result.outcome == Tablebase::Result::LOSS)
+          return -1000 + result.plies;
+        return 0;
+      };
+      return rank(a) >= rank(b) ? a : b;
+    }
+
+    // Multisets of count piece types, strongest first
+    void materials(int count, int first, const std::string& prefix,
+                   std::vector<std::string>& result)
+    {
+      if (count == 0)
+      {
+        result.push_back(prefix);
+        return;
+      }
+      for (int type = first; type < 5; ++type)
+        materials(count - 1, type, prefix + types[type], result);
+    }
+
+    struct Position
+    {
+      squares_t squares;
+      plugin::Color side;
+    };
+
+    // A move of piece from a position, maybe taking piece captured (-1 for
+    // none) or promoting (to KING for none)
+    struct Move
+    {
+      Position position;
+      int piece;
+      int captured;
+      plugin::PieceType promotion;
+    };
+
+    class Generator
+    {
+    public:
+      Generator(const std::string& name, const tables_t& tables)
+        : layout_(Tablebase::layout_get(name))
+        , tables_(tables)
+        , count_(layout_.pieces.size())
+        , values_(layout_.size, 0)
+        , exit_wins_(layout_.size, none)
+        , en_passant_wins_(layout_.size, none)
+        , candidates_(layout_.size, false)
+      {}
+
+      std::vector<uint8_t> run();
+
+    private:
+      plugin::Color color_get(int piece) const {
+        return layout_.pieces[piece].color;
+      }
+      plugin::PieceType type_get(int piece) const {
+        return layout_.pieces[piece].type;
+      }
+
+      bool attacked(const squares_t& squares, bitboard_t occupancy,
+                    plugin::Color by, square_t square, int captured) const;
+      bool in_check(const Position& position, plugin::Color color,
+                    int captured = -1) const;
+      template <typename F>
+      void moves_for_each(const Position& position, F f) const;
+      template <typename F>
+      void unmoves_for_each(const Position& position, F f) const;
+      Tablebase::Result exit_result(const Move& move) const;
+      // Piece that made a double push from before to after, -1 if none
+      int double_push(const Position& before, const Position& after) const;
+      // Result for the side to move of its best en passant capture of pawn,
+      // which just made a double push, false if there is none. Table
+      // positions have no en passant square, the move that leads to one is
+      // scored with the capture.
+      bool en_passant_get(const Position& position, int pawn,
+                          Tablebase::Result& result) const;
+
+      void initialize(size_t index);
+      // Plies to the mate when every move of the position loses, -1 if one
+      // does not yet once the wins in plies plies are known
+      int loss_get(const Position& position, int plies) const;
+      void assign(size_t index, Tablebase::Result result);
+
+      const Tablebase::Layout layout_;
+      const tables_t& tables_;
+      const int count_;
+      std::vector<uint8_t> values_;
+      // Plies of the fastest win by a capture or a promotion, or by a double
+      // push the en passant capture of which loses slower than the push
+      std::vector<uint8_t> exit_wins_;
+      // Plies of the opponent's win by an en passant capture, after which the
+      // position is checked for a loss
+      std::vector<uint8_t> en_passant_wins_;
+      // Positions one of the moves of which just got lost
+      std::vector<bool> candidates_;
+      int highest_ = 0;
+    };
+
+    bool Generator::attacked(const squares_t& squares, bitboard_t occupancy,
+                             plugin::Color by, square_t square,
+                             int captured) const
+    {
+      for (int i = 0; i < count_; ++i)
+        if (i != captured and color_get(i) == by
+            and (attacks::piece_attacks(type_get(i), by, squares[i], occupancy)
+                 & bitboard::square_bb(square)))
+          return true;
+      return false;
+    }
+
+    bool Generator::in_check(const Position& position, plugin::Color color,
+                             int captured) const
+    {
+      bitboard_t occupancy = bitboard::empty;
+      for (int i = 0; i < count_; ++i)
+        if (i != captured)
+          occupancy |= bitboard::square_bb(position.squares[i]);
+      // Kings come first in the layout, white then black
+      return attacked(position.squares, occupancy, !color,
+                      position.squares[static_cast<bool>(color)], captured);
+    }
+
+    template <typename F>
+    void Generator::moves_for_each(const Position& position, F f) const
+    {
+      bitboard_t own = bitboard::empty;
+      bitboard_t occupancy = bitboard::empty;
+      for (int i = 0; i < count_; ++i)
+      {
+        occupancy |= bitboard::square_bb(position.squares[i]);
+        if (color_get(i) == position.side)
+          own |= bitboard::square_bb(position.squares[i]);
+      }
+      bool white = position.side == plugin::Color::WHITE;
+      for (int i = 0; i < count_; ++i)
+      {
+        if (color_get(i) != position.side)
+          continue;
+        square_t from = position.squares[i];
+        bitboard_t targets;
+        if (type_get(i) == plugin::PieceType::PAWN)
+        {
+          targets = attacks::pawn_attacks(position.side, from)
+            & occupancy & ~own;
+          square_t push = white ? from + 8 : from - 8;
+          if (not (occupancy & bitboard::square_bb(push)))
+          {
+            targets |= bitboard::square_bb(push);
+            square_t jump = white ? push + 8 : push - 8;
+            if (bitboard::rank_of(from) == (white ? 1 : 6)
+                and not (occupancy & bitboard::square_bb(jump)))
+              targets |= bitboard::square_bb(jump);
+          }
+        }
+        else
+          targets = attacks::piece_attacks(type_get(i), position.side, from,
+                                           occupancy) & ~own;
+        while (targets)
+        {
+          square_t to = bitboard::pop_lsb(targets);
+          Move move{position, i, -1, plugin::PieceType::KING};
+          move.position.squares[i] = to;
+          move.position.side = !position.side;
+          for (int j = 0; j < count_; ++j)
+            if (j != i and position.squares[j] == to)
+              move.captured = j;
+          if (in_check(move.position, position.side, move.captured))
+            continue;
+          if (type_get(i) == plugin::PieceType::PAWN
+              and bitboard::rank_of(to) == (white ? 7 : 0))
+            for (auto promotion : {plugin::PieceType::QUEEN,
+                                   plugin::PieceType::ROOK,
+                                   plugin::PieceType::BISHOP,
+                                   plugin::PieceType::KNIGHT})
+            {
+              move.promotion = promotion;
+              f(move);
+            }
+          else
+            f(move);
+        }
+      }
+    }
+
+    // Positions of the other side to move that have a move to position, no
+    // capture nor promotion
+    template <typename F>
+    void Generator::unmoves_for_each(const Position& position, F f) const
+    {
+      bitboard_t occupancy = bitboard::empty;
+      for (int i = 0; i < count_; ++i)
+        occupancy |= bitboard::square_bb(position.squares[i]);
+      plugin::Color mover = !position.side;
+      bool white = mover == plugin::Color::WHITE;
+      for (int i = 0; i < count_; ++i)
+      {
+        if (color_get(i) != mover)
+          continue;
+        square_t to = position.squares[i];
+        bitboard_t origins;
+        if (type_get(i) == plugin::PieceType::PAWN)
+        {
+          origins = bitboard::empty;
+          square_t back = white ? to - 8 : to + 8;
+          int rank = bitboard::rank_of(back);
+          if (rank != 0 and rank != 7
+              and not (occupancy & bitboard::square_bb(back)))
+          {
+            origins |= bitboard::square_bb(back);
+            square_t start = white ? back - 8 : back + 8;
+            if (bitboard::rank_of(to) == (white ? 3 : 4)
+                and not (occupancy & bitboard::square_bb(start)))
+              origins |= bitboard::square_bb(start);
+          }
+        }
+        else
+          origins = attacks::piece_attacks(type_get(i), mover, to, occupancy)
+            & ~occupancy;
+        while (origins)
+        {
+          Position previous{position.squares, mover};
+          previous.squares[i] = bitboard::pop_lsb(origins);
+          if (not in_check(previous, position.side))
+            f(previous);
+        }
+      }
+    }
+
+    Tablebase::Result Generator::exit_result(const Move& move) const
+    {
+      std::vector<Tablebase::Piece> pieces;
+      for (int i = 0; i < count_; ++i)
+        if (i != move.captured)
+          pieces.push_back({color_get(i),
+                            i == move.piece
+                            and move.promotion != plugin::PieceType::KING
+                            ? move.promotion : type_get(i),
+                            move.position.squares[i]});
+      if (pieces.size() == 2)
+        return {Tablebase::Result::DRAW, 0};
+      std::string name;
+      size_t index = Tablebase::index_get(pieces, move.position.side, name);
+      auto table = tables_.find(name);
+      if (table == tables_.end())
+        throw std::logic_error(layout_.name + " needs " + name);
+      return Tablebase::result_get(table->second[index]);
+    }
+
+    int Generator::double_push(const Position& before,
+                               const Position& after) const
+    {
+      for (int i = 0; i < count_; ++i)
+        if (before.squares[i] != after.squares[i])
+          return type_get(i) == plugin::PieceType::PAWN
+            and std::abs(before.squares[i] - after.squares[i]) == 16 ? i : -1;
+      return -1;
+    }
+
+    bool Generator::en_passant_get(const Position& position, int pawn,
+                                   Tablebase::Result& result) const
+    {
+      square_t passed = color_get(pawn) == plugin::Color::WHITE
+        ? position.squares[pawn] - 8 : position.squares[pawn] + 8;
+      bool found = false;
+      for (int i = 0; i < count_; ++i)
+      {
+        if (color_get(i) != position.side
+            or type_get(i) != plugin::PieceType::PAWN
+            or not (attacks::pawn_attacks(position.side, position.squares[i])
+                    & bitboard::square_bb(passed)))
+          continue;
+        Move capture{position, i, pawn, plugin::PieceType::KING};
+        capture.position.squares[i] = passed;
+        capture.position.side = !position.side;
+        if (in_check(capture.position, position.side, pawn))
+          continue;
+        auto exit = exit_result(capture);
+        Tablebase::Result own = {Tablebase::Result::DRAW, 0};
+        if (exit.outcome == Tablebase::Result::LOSS)
+          own = {Tablebase::Result::WIN, exit.plies + 1};
+        else if (exit.outcome == Tablebase::Result::WIN)
+          own = {Tablebase::Result::LOSS, exit.plies + 1};
+        result = found ? better(result, own) : own;
+        found = true;
+      }
+      return found;
+    }
+
+    void Generator::assign(size_t index, Tablebase::Result result)
+    {
+      if (result.plies > 253)
+        throw std::overflow_error("Mate too far in " + layout_.name);
+      values_[index] = Tablebase::value_get(result);
+      highest_ = std::max(highest_, result.plies);
+    }
+
+    void Generator::initialize(size_t index)
+    {
+      Position position;
+      if (not Tablebase::position_get(layout_, index, position.squares,
+                                      position.side)
+          or in_check(position, !position.side))
+      {
+        values_[index] = invalid;
+        return;
+      }
+      int moves = 0;
+      int table_moves = 0;
+      int exit_win = none;
+      bool exit_draw = false;
+      int exit_loss = -1;
+      moves_for_each(position, [&](const Move& move) {
+        ++moves;
+        if (move.captured < 0 and move.promotion == plugin::PieceType::KING)
+        {
+          ++table_moves;
+          int pawn = double_push(position, move.position);
+          Tablebase::Result capture;
+          if (pawn >= 0 and en_passant_get(move.position, pawn, capture)
+              and capture.outcome == Tablebase::Result::WIN)
+            en_passant_wins_[index] = std::min<int>(en_passant_wins_[index],
+                                                    capture.plies);
+          return;
+        }
+        auto result = exit_result(move);
+        if (result.outcome == Tablebase::Result::LOSS)
+          exit_win = std::min(exit_win, result.plies + 1);
+        else if (result.outcome == Tablebase::Result::DRAW)
+          exit_draw = true;
+        else
+          exit_loss = std::max(exit_loss, result.plies + 1);
+      });
+      if (moves == 0)
+      {
+        // Stalemates are draws
+        if (in_check(position, position.side))
+          assign(index, {Tablebase::Result::LOSS, 0});
+      }
+      else if (table_moves == 0)
+      {
+        if (exit_win != none)
+          assign(index, {Tablebase::Result::WIN, exit_win});
+        else if (not exit_draw)
+          assign(index, {Tablebase::Result::LOSS, exit_loss});
+      }
+      else
+        exit_wins_[index] = exit_win;
+    }
+
+    int Generator::loss_get(const Position& position, int plies) const
+    {
+      int loss = 0;
+      bool lost = true;
+      moves_for_each(position, [&](const Move& move) {
+        if (not lost)
+          return;
+        Tablebase::Result result;
+        if (move.captured < 0 and move.promotion == plugin::PieceType::KING)
+        {
+          uint8_t value = values_[Tablebase::index_get(
+              layout_, move.position.squares, move.position.side)];
+          result = Tablebase::result_get(value);
+          int pawn = double_push(position, move.position);
+          Tablebase::Result capture;
+          if (pawn >= 0 and en_passant_get(move.position, pawn, capture))
+          {
+            // A faster win without the capture may still be found
+            if (value == 0 and capture.outcome == Tablebase::Result::WIN
+                and capture.plies > plies)
+            {
+              lost = false;
+              return;
+            }
+            result = better(result, capture);
+          }
+        }
+        else
+          result = exit_result(move);
+        if (result.outcome == Tablebase::Result::WIN)
+          loss = std::max(loss, result.plies + 1);
+        else
+          lost = false;
+      });
+      return lost ? loss : -1;
+    }
+
+    std::vector<uint8_t> Generator::run()
+    {
+      for (size_t index = 0; index < layout_.size; ++index)
+        initialize(index);
+      int last_exit_win = 0;
+      for (uint8_t plies : exit_wins_)
+        if (plies != none)
+          last_exit_win = std::max<int>(last_exit_win, plies);
+      for (uint8_t plies : en_passant_wins_)
+        if (plies != none)
+          last_exit_win = std::max<int>(last_exit_win, plies);
+
+      for (int plies = 0; plies <= std::max(highest_, last_exit_win); ++plies)
+      {
+        uint8_t value = plies + 1;
+        bool losses = plies % 2 == 0;
+        for (size_t index = 0; index < layout_.size; ++index)
+        {
+          if (values_[index] != value)
+            continue;
+          Position position;
+          Tablebase::position_get(layout_, index, position.squares,
+                                  position.side);
+          unmoves_for_each(position, [&](const Position& previous) {
+            size_t previous_index = Tablebase::index_get(
+                layout_, previous.squares, previous.side);
+            if (values_[previous_index] != 0)
+              return;
+            if (not losses)
+            {
+              candidates_[previous_index] = true;
+              return;
+            }
+            // The opponent may rather take the pawn en passant
+            Tablebase::Result reply = {Tablebase::Result::LOSS, plies};
+            int pawn = double_push(previous, position);
+            Tablebase::Result capture;
+            if (pawn >= 0 and en_passant_get(position, pawn, capture))
+              reply = better(reply, capture);
+            if (reply.outcome != Tablebase::Result::LOSS)
+              return;
+            if (reply.plies == plies)
+              assign(previous_index, {Tablebase::Result::WIN, plies + 1});
+            else
+            {
+              auto& exit_win = exit_wins_[previous_index];
+              exit_win = std::min<int>(exit_win, reply.plies + 1);
+              last_exit_win = std::max(last_exit_win, reply.plies + 1);
+            }
+          });
+        }
+        for (size_t index = 0; index < layout_.size; ++index)
+        {
+          if (losses and exit_wins_[index] == plies + 1
+              and values_[index] == 0)
+            assign(index, {Tablebase::Result::WIN, plies + 1});
+          if (not losses and en_passant_wins_[index] == plies)
+            candidates_[index] = true;
+          if (not candidates_[index])
+            continue;
+          candidates_[index] = false;
+          if (values_[index] != 0)
+            continue;
+          Position position;
+          Tablebase::position_get(layout_, index, position.squares,
+                                  position.side);
+          int loss = loss_get(position, plies);
+          if (loss >= 0)
+            assign(index, {Tablebase::Result::LOSS, loss});
+        }
+      }
+
+      for (auto& value : values_)
+        if (value == invalid)
+          value = 0;
+      return values_;
+    }
+  }
+
+  std::vector<std::vector<std::string>> schedule(int pieces)
+  {
+    // A capture takes a piece off, a promotion a pawn: the tables of the
+    // same batch never lead to each other
+    std::vector<std::vector<std::string>> batches;
+    for (int count = 3; count <= pieces; ++count)
+      for (int pawns = 0; pawns <= count - 2; ++pawns)
+      {
+        std::set<std::string> names;
+        for (int white = count - 2; white >= 0; --white)
+        {
+          std::vector<std::string> whites;
+          std::vector<std::string> blacks;
+          materials(white, 0, "", whites);
+          materials(count - 2 - white, 0, "", blacks);
+          for (const auto& w : whites)
+            for (const auto& b : blacks)
+            {
+              std::string all = w + b;
+              if (std::count(all.begin(), all.end(), 'P') == pawns)
+                names.insert(Tablebase::name_get(w, b));
+            }
+        }
+        if (not names.empty())
+          batches.emplace_back(names.begin(), names.end());
+      }
+    return batches;
+  }
+
+  std::vector<std::string> dependencies(const std::string& name)
+  {
+    auto layout = Tablebase::layout_get(name);
+    std::set<std::string> names;
+    for (size_t i = 2; i < layout.pieces.size(); ++i)
+    {
+      std::vector<char> replacements = {0};
+      if (layout.pieces[i].type == plugin::PieceType::PAWN)
+        replacements.insert(replacements.end(), types, types + 4);
+      for (char replacement : replacements)
+      {
+        std::string white;
+        std::string black;
+        for (size_t j = 2; j < layout.pieces.size(); ++j)
+        {
+          char type = j != i ? static_cast<char>(layout.pieces[j].type)
+            : replacement;
+          if (type)
+            (layout.pieces[j].color == plugin::Color::WHITE ? white : black)
+              += type;
+        }
+        auto strength = [](char a, char b) {
+          return std::strchr(types, a) < std::strchr(types, b);
+        };
+        std::sort(white.begin(), white.end(), strength);
+        std::sort(black.begin(), black.end(), strength);
+        if (not white.empty() or not black.empty())
+          names.insert(Tablebase::name_get(white, black));
+      }
+    }
+    return {names.begin(), names.end()};
+  }
+
+  std::vector<uint8_t> generate(const std::string& name,
+                                const tables_t& tables)
+  {
+    return Generator(name, tables).run();
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "tablebase.hh"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+** Tablebase generation by retrograde analysis.
+**
+** Mates are found first. Then, one ply at a time, the positions that can
+** move to a position lost in n plies are won in n + 1, found by generating
+** the moves that lead to the lost position backwards. Their predecessors
+** are then checked: when every move leads to a position the opponent wins,
+** the position is lost. Captures and promotions leave the table, their
+** values come from the smaller tables, which have to be generated first.
+** Positions never reached this way are draws. A double push the opponent
+** may answer by taking en passant is scored with that capture, as the
+** position it leads to is only stored without it.
+*/
+namespace tablebase_generator
+{
+  using tables_t = std::unordered_map<std::string, std::vector<uint8_t>>;
+
+  /* Names of the tables with up to pieces pieces, in batches that only
+   * depend on the batches before them */
+  std::vector<std::vector<std::string>> schedule(int pieces);
+
+  /* Tables the captures and promotions of the table name lead to */
+  std::vector<std::string> dependencies(const std::string& name);
+
+  /* Values of the table name, tables holding the smaller ones */
+  std::vector<uint8_t> generate(const std::string& name,
+                                const tables_t& tables);
+}
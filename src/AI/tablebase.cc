@@ -0,0 +1,425 @@
+#include "tablebase.hh"
+#include "plugin-auxiliary.hh"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+constexpr int Tablebase::max_pieces;
+
+namespace
+{
+  const char magic[4] = {'P', 'P', 'T', 'B'};
+  const size_t name_size = 16;
+  const size_t header_entry_size = name_size + 16;
+
+  // Squares the white king is brought on, without pawns
+  const Tablebase::square_t triangle[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+
+  int region_size(bool pawns)
+  {
+    return pawns ? 32 : 10;
+  }
+
+  int region_index(bool pawns, Tablebase::square_t square)
+  {
+    if (pawns)
+      return bitboard::file_of(square) < 4
+        ? bitboard::rank_of(square) * 4 + bitboard::file_of(square) : -1;
+    auto found = std::find(triangle, triangle + 10, square);
+    return found == triangle + 10 ? -1 : found - triangle;
+  }
+
+  Tablebase::square_t region_square(bool pawns, int index)
+  {
+    return pawns ? bitboard::square_of(index % 4, index / 4) : triangle[index];
+  }
+
+  // Bit 0 mirrors the files, bit 1 the ranks, bit 2 swaps files and ranks
+  Tablebase::square_t symmetric(Tablebase::square_t square, int symmetry)
+  {
+    int file = bitboard::file_of(square);
+    int rank = bitboard::rank_of(square);
+    if (symmetry & 4)
+      std::swap(file, rank);
+    if (symmetry & 1)
+      file = 7 - file;
+    if (symmetry & 2)
+      rank = 7 - rank;
+    return bitboard::square_of(file, rank);
+  }
+
+  // Index order of the pieces, kings first
+  int order(const Tablebase::Piece& piece)
+  {
+    int type = auxiliary::PieceTypeToInt(piece.type);
+    if (type == 0)
+      return static_cast<bool>(piece.color);
+    return 2 + 6 * static_cast<bool>(piece.color) + type;
+  }
+
+  // Types other than the king, strongest first
+  std::string material(const std::vector<Tablebase::Piece>& pieces,
+                       plugin::Color color)
+  {
+    std::vector<Tablebase::Piece> own;
+    for (const auto& piece : pieces)
+      if (piece.color == color and piece.type != plugin::PieceType::KING)
+        own.push_back(piece);
+    std::sort(own.begin(), own.end(),
+              [](const Tablebase::Piece& a, const Tablebase::Piece& b) {
+                return order(a) < order(b);
+              });
+    std::string types;
+    for (const auto& piece : own)
+      types += static_cast<char>(piece.type);
+    return types;
+  }
+
+  // Whether the first material beats the second: more pieces, then
+  // stronger ones
+  bool stronger(const std::string& a, const std::string& b)
+  {
+    if (a.size() != b.size())
+      return a.size() > b.size();
+    for (size_t i = 0; i < a.size(); ++i)
+      if (a[i] != b[i])
+        return auxiliary::PieceTypeToInt(static_cast<plugin::PieceType>(a[i]))
+          < auxiliary::PieceTypeToInt(static_cast<plugin::PieceType>(b[i]));
+    return false;
+  }
+
+  // Four bits per color and type, there are never more than max_pieces
+  Tablebase::signature_t signature_bit(bool second, plugin::PieceType type)
+  {
+    return Tablebase::signature_t(1)
+      << 4 * (6 * second + auxiliary::PieceTypeToInt(type));
+  }
+
+  uint64_t read_little_endian(const unsigned char* bytes)
+  {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+      value = value << 8 | bytes[i];
+    return value;
+  }
+
+  void write_little_endian(std::ostream& out, uint64_t value)
+  {
+    for (int i = 0; i < 8; ++i)
+      out.put(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+std::string Tablebase::name_get(const std::string& white,
+                                const std::string& black)
+{
+  if (stronger(black, white))
+    return "K" + black + "vK" + white;
+  return "K" + white + "vK" + black;
+}
+
+Tablebase::Layout Tablebase::layout_get(const std::string& name)
+{
+  auto separator = name.find('v');
+  if (name.size() < 3 or name[0] != 'K' or separator == std::string::npos
+      or separator + 1 >= name.size() or name[separator + 1] != 'K')
+    throw std::invalid_argument("Invalid table name " + name);
+  Layout layout;
+  layout.name = name;
+  layout.pawns = false;
+  layout.pieces.push_back({plugin::Color::WHITE, plugin::PieceType::KING, 0});
+  layout.pieces.push_back({plugin::Color::BLACK, plugin::PieceType::KING, 0});
+  for (size_t i = 1; i < name.size(); ++i)
+  {
+    if (i == separator or i == separator + 1)
+      continue;
+    auto type = static_cast<plugin::PieceType>(name[i]);
+    const auto& types = plugin::piecetype_array();
+    if (std::find(types.begin() + 1, types.end(), type) == types.end())
+      throw std::invalid_argument("Invalid table name " + name);
+    layout.pieces.push_back({i < separator ? plugin::Color::WHITE
+                             : plugin::Color::BLACK, type, 0});
+    layout.pawns |= type == plugin::PieceType::PAWN;
+  }
+  if (layout.pieces.size() > max_pieces)
+    throw std::invalid_argument("Too many pieces in " + name);
+  std::stable_sort(layout.pieces.begin(), layout.pieces.end(),
+                   [](const Piece& a, const Piece& b) {
+                     return order(a) < order(b);
+                   });
+  layout.size = 2 * region_size(layout.pawns);
+  for (size_t i = 1; i < layout.pieces.size(); ++i)
+    layout.size *= 64;
+  return layout;
+}
+
+size_t Tablebase::index_get(std::vector<Piece> pieces, plugin::Color side,
+                            std::string& name)
+{
+  std::string white = material(pieces, plugin::Color::WHITE);
+  std::string black = material(pieces, plugin::Color::BLACK);
+  if (stronger(black, white))
+  {
+    // Same position seen from the other side
+    for (auto& piece : pieces)
+    {
+      piece.color = !piece.color;
+      piece.square ^= 56;
+    }
+    side = !side;
+    std::swap(white, black);
+  }
+  name = "K" + white + "vK" + black;
+  std::stable_sort(pieces.begin(), pieces.end(),
+                   [](const Piece& a, const Piece& b) {
+                     return order(a) < order(b);
+                   });
+  std::array<square_t, max_pieces> squares;
+  for (size_t i = 0; i < pieces.size(); ++i)
+    squares[i] = pieces[i].square;
+  return index_get(layout_get(name), squares, side);
+}
+
+size_t Tablebase::index_get(const Layout& layout,
+                            const std::array<square_t, max_pieces>& squares,
+                            plugin::Color side)
+{
+  size_t count = layout.pieces.size();
+  size_t best = -1;
+  std::array<square_t, max_pieces> symmetric_squares;
+  for (int symmetry = 0; symmetry < (layout.pawns ? 2 : 8); ++symmetry)
+  {
+    for (size_t i = 0; i < count; ++i)
+      symmetric_squares[i] = symmetric(squares[i], symmetry);
+    int king = region_index(layout.pawns, symmetric_squares[0]);
+    if (king < 0)
+      continue;
+    // Alike pieces may be swapped, the lowest square goes first
+    for (size_t i = 2; i < count;)
+    {
+      size_t end = i + 1;
+      while (end < count
+             and order(layout.pieces[end]) == order(layout.pieces[i]))
+        ++end;
+      std::sort(symmetric_squares.begin() + i,
+                symmetric_squares.begin() + end);
+      i = end;
+    }
+    size_t index = static_cast<bool>(side) * region_size(layout.pawns) + king;
+    for (size_t i = 1; i < count; ++i)
+      index = index * 64 + symmetric_squares[i];
+    best = std::min(best, index);
+  }
+  return best;
+}
+
+bool Tablebase::position_get(const Layout& layout, size_t index,
+                             std::array<square_t, max_pieces>& squares,
+                             plugin::Color& side)
+{
+  size_t count = layout.pieces.size();
+  size_t rest = index;
+  for (size_t i = count - 1; i > 0; --i)
+  {
+    squares[i] = rest % 64;
+    rest /= 64;
+  }
+  squares[0] = region_square(layout.pawns, rest % region_size(layout.pawns));
+  side = static_cast<plugin::Color>(rest / region_size(layout.pawns));
+  bitboard::bitboard_t occupancy = bitboard::empty;
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto square_bb = bitboard::square_bb(squares[i]);
+    if (occupancy & square_bb)
+      return false;
+    if (layout.pieces[i].type == plugin::PieceType::PAWN
+        and (square_bb & (bitboard::rank_1 | bitboard::rank_8)))
+      return false;
+    occupancy |= square_bb;
+  }
+  return index_get(layout, squares, side) == index;
+}
+
+Tablebase::signature_t Tablebase::signature_get(const Layout& layout)
+{
+  signature_t signature = 0;
+  for (const auto& piece : layout.pieces)
+    signature += signature_bit(static_cast<bool>(piece.color), piece.type);
+  return signature;
+}
+
+Tablebase::signature_t Tablebase::signature_get(const ChessBoard& board,
+                                                plugin::Color first)
+{
+  signature_t signature = 0;
+  for (auto color : {first, !first})
+    for (auto type : plugin::piecetype_array())
+      signature += board.piece_count_get(color, type)
+        * signature_bit(color != first, type);
+  return signature;
+}
+
+Tablebase::Result Tablebase::result_get(uint8_t value)
+{
+  if (value == 0)
+    return {Result::DRAW, 0};
+  int plies = value - 1;
+  return {plies % 2 ? Result::WIN : Result::LOSS, plies};
+}
+
+uint8_t Tablebase::value_get(Result result)
+{
+  return result.outcome == Result::DRAW ? 0 : result.plies + 1;
+}
+
+Tablebase::~Tablebase()
+{
+  close();
+}
+
+bool Tablebase::open(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat status;
+  if (fstat(fd, &status) < 0 or status.st_size < 8)
+  {
+    ::close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  data_ = static_cast<const unsigned char*>(data);
+  length_ = status.st_size;
+
+  size_t count = read_little_endian(data_) >> 32;
+  if (std::memcmp(data_, magic, 4) != 0
+      or 8 + count * header_entry_size > length_)
+  {
+    close();
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    const unsigned char* entry = data_ + 8 + i * header_entry_size;
+    std::string name(reinterpret_cast<const char*>(entry),
+                     strnlen(reinterpret_cast<const char*>(entry), name_size));
+    size_t offset = read_little_endian(entry + name_size);
+    size_t size = read_little_endian(entry + name_size + 8);
+    try
+    {
+      Layout layout = layout_get(name);
+      if (size != layout.size or offset > length_ or size > length_ - offset)
+        throw std::invalid_argument("Truncated table " + name);
+      pieces_max_ = std::max(pieces_max_,
+                             static_cast<int>(layout.pieces.size()));
+      signature_t signature = signature_get(layout);
+      tables_[signature] = {std::move(layout), data_ + offset};
+    }
+    catch (const std::invalid_argument&)
+    {
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void Tablebase::close()
+{
+  if (data_)
+    munmap(const_cast<unsigned char*>(data_), length_);
+  data_ = nullptr;
+  length_ = 0;
+  tables_.clear();
+  pieces_max_ = 0;
+}
+
+bool Tablebase::probe(const ChessBoard& board, Result& result) const
+{
+  int count = bitboard::popcount(board.occupancy_bb());
+  if (count > pieces_max_ or board.castling_rights_get() != 0
+      or board.en_passant_get() != -1)
+    return false;
+  if (count == 2)
+  {
+    result = {Result::DRAW, 0};
+    return true;
+  }
+  // Tables only exist with the stronger side as white: a position found
+  // with black as white is the same with the colors swapped
+  plugin::Color first = plugin::Color::WHITE;
+  auto table = tables_.find(signature_get(board, first));
+  if (table == tables_.end())
+  {
+    first = plugin::Color::BLACK;
+    table = tables_.find(signature_get(board, first));
+    if (table == tables_.end())
+      return false;
+  }
+  // Kings, then the pieces of each side from queen to pawn
+  square_t flip = first == plugin::Color::WHITE ? 0 : 56;
+  std::array<square_t, max_pieces> squares;
+  size_t n = 0;
+  for (auto color : {first, !first})
+    squares[n++] = board.piece_list_get(color, plugin::PieceType::KING)[0]
+      ^ flip;
+  for (auto color : {first, !first})
+    for (auto type : plugin::piecetype_array())
+    {
+      if (type == plugin::PieceType::KING)
+        continue;
+      const auto& list = board.piece_list_get(color, type);
+      for (int i = 0; i < board.piece_count_get(color, type); ++i)
+        squares[n++] = list[i] ^ flip;
+    }
+  plugin::Color side = board.side_to_move_get();
+  if (first == plugin::Color::BLACK)
+    side = !side;
+  size_t index = index_get(table->second.layout, squares, side);
+  result = result_get(table->second.values[index]);
+  return true;
+}
+
+void Tablebase::save(const std::string& path,
+                     const std::unordered_map<std::string,
+                                              std::vector<uint8_t>>& tables)
+{
+  std::vector<std::string> names;
+  for (const auto& table : tables)
+    names.push_back(table.first);
+  std::sort(names.begin(), names.end());
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (not out)
+    throw std::runtime_error("Cannot write the tablebase " + path);
+  out.write(magic, 4);
+  for (int i = 0; i < 4; ++i)
+    out.put(static_cast<char>(names.size() >> (8 * i)));
+  size_t offset = 8 + names.size() * header_entry_size;
+  for (const auto& name : names)
+  {
+    char padded[name_size] = {};
+    std::strncpy(padded, name.c_str(), name_size - 1);
+    out.write(padded, name_size);
+    write_little_endian(out, offset);
+    write_little_endian(out, tables.at(name).size());
+    offset += tables.at(name).size();
+  }
+  for (const auto& name : names)
+    out.write(reinterpret_cast<const char*>(tables.at(name).data()),
+              tables.at(name).size());
+  if (not out)
+    throw std::runtime_error("Cannot write the tablebase " + path);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "bitboard.hh"
+#include "chessboard.hh"
+#include "plugin/color.hh"
+#include "plugin/piece-type.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+** Endgame tablebase, the distance to mate of every position with few
+** pieces, as computed by tbgen.
+**
+** There is one table per material, named like KRPvKN with the stronger
+** side first: positions where black is stronger are looked up with the
+** colors swapped. Once open, tables are found by the signature of their
+** material, the counts of each piece type of both sides in an integer. A table holds a byte per position, 0 for a draw and the
+** distance to mate in plies plus one otherwise, odd distances being wins of
+** the side to move.
+**
+** A position is indexed by the side to move and the squares of its pieces:
+** the white king, the black king, then the other white and black pieces
+** from queen to pawn. Board symmetries bring the white king on the a1-d1-d4
+** triangle, or on the a-d files when pawns tie the board to its ranks.
+** Castling and en passant are left out, such positions are not probed.
+*/
+class Tablebase
+{
+public:
+  using square_t = bitboard::square_t;
+  using signature_t = uint64_t;
+
+  static constexpr int max_pieces = 4;
+
+  struct Piece
+  {
+    plugin::Color color;
+    plugin::PieceType type;
+    square_t square;
+  };
+
+  /* Pieces of a table, in index order, and its number of positions */
+  struct Layout
+  {
+    std::string name;
+    std::vector<Piece> pieces;
+    bool pawns;
+    size_t size;
+  };
+
+  struct Result
+  {
+    enum Outcome
+    {
+      LOSS,
+      DRAW,
+      WIN
+    };
+    /* For the side to move */
+    Outcome outcome;
+    /* Until mate, 0 when mated */
+    int plies;
+  };
+
+  /* Name of the table of a material, given as the types other than the
+   * king from the strongest, e.g. KRPvKN for RP and N */
+  static std::string name_get(const std::string& white,
+                              const std::string& black);
+  /* Throws std::invalid_argument if name is not a table name */
+  static Layout layout_get(const std::string& name);
+  /* Table of the position and its index there. Of the positions the
+   * symmetries make equal, all give the index of the same one. */
+  static size_t index_get(std::vector<Piece> pieces, plugin::Color side,
+                          std::string& name);
+  /* Same, for the squares of the pieces of a table in index order */
+  static size_t index_get(const Layout& layout,
+                          const std::array<square_t, max_pieces>& squares,
+                          plugin::Color side);
+  /* Position at index, false if the index is not the one index_get gives
+   * for it or if pieces share a square */
+  static bool position_get(const Layout& layout, size_t index,
+                           std::array<square_t, max_pieces>& squares,
+                           plugin::Color& side);
+  /* Material signature of a table, and of a board with the pieces of
+   * first as the white ones */
+  static signature_t signature_get(const Layout& layout);
+  static signature_t signature_get(const ChessBoard& board,
+                                   plugin::Color first);
+  /* Stored byte to result and back */
+  static Result result_get(uint8_t value);
+  static uint8_t value_get(Result result);
+
+  Tablebase() = default;
+  Tablebase(const Tablebase&) = delete;
+  Tablebase& operator=(const Tablebase&) = delete;
+  ~Tablebase();
+
+  /* Maps the tables of a tbgen file, returns false if it cannot be read */
+  bool open(const std::string& path);
+  void close();
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+  /* Most pieces on the board a table exists for */
+  int pieces_max_get() const {
+    return pieces_max_;
+  }
+
+  /* False if the position has no table. Does not allocate. */
+  bool probe(const ChessBoard& board, Result& result) const;
+
+  /* Writes the tables at path, throws std::runtime_error on failure */
+  static void save(const std::string& path,
+                   const std::unordered_map<std::string,
+                                            std::vector<uint8_t>>& tables);
+
+private:
+  struct Table
+  {
+    Layout layout;
+    const uint8_t* values;
+  };
+
+  const unsigned char* data_ = nullptr;
+  size_t length_ = 0;
+  std::unordered_map<signature_t, Table> tables_;
+  int pieces_max_ = 0;
+};
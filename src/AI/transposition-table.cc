@@ -0,0 +1,133 @@
+#include "transposition-table.hh"
+#include <algorithm>
+
+constexpr size_t TranspositionTable::default_megabytes;
+
+TranspositionTable::TranspositionTable(size_t megabytes)
+{
+  resize(megabytes);
+}
+
+// Rounds down to a power of two number of buckets, at least one
+void TranspositionTable::resize(size_t megabytes)
+{
+  size_t count = 1;
+  while (2 * count * sizeof(Bucket) <= megabytes * 1024 * 1024)
+    count *= 2;
+  bucket_count_ = count;
+  // new does not honor the alignment of Bucket before C++17
+  memory_.reset(new char[count * sizeof(Bucket) + alignof(Bucket)]);
+  uintptr_t address = reinterpret_cast<uintptr_t>(memory_.get());
+  address = (address + alignof(Bucket) - 1) & ~(alignof(Bucket) - 1);
+  buckets_ = reinterpret_cast<Bucket*>(address);
+  clear();
+}
+
+void TranspositionTable::clear()
+{
+  for (size_t i = 0; i < bucket_count_; ++i)
+    for (auto& slot : buckets_[i].slots)
+    {
+      slot.check.store(0, std::memory_order_relaxed);
+      slot.data.store(0, std::memory_order_relaxed);
+    }
+  age_ = 0;
+}
+
+void TranspositionTable::new_search()
+{
+  age_ = (age_ + 1) & 63;
+}
+
+uint64_t TranspositionTable::pack(const Entry& entry)
+{
+  return static_cast<uint32_t>(entry.score)
+    | static_cast<uint64_t>(entry.move.data_get()) << 32
+    | static_cast<uint64_t>(static_cast<uint8_t>(entry.depth)) << 48
+    | static_cast<uint64_t>(entry.bound | entry.age << 2) << 56;
+}
+
+TranspositionTable::Entry TranspositionTable::unpack(key_t key, uint64_t data)
+{
+  Entry entry;
+  uint16_t move = data >> 32;
+  entry.key = key;
+  entry.score = static_cast<int32_t>(data);
+  entry.move = CompactMove(move & 0x3F, (move >> 6) & 0x3F, move >> 12);
+  entry.depth = static_cast<int8_t>(data >> 48);
+  entry.bound = (data >> 56) & 0b11;
+  entry.age = data >> 58;
+  return entry;
+}
+
+// A slot of zeros is empty, it would otherwise match the key 0. An entry
+// packed into zeros is lost, it holds nothing but a draw at depth 0.
+bool TranspositionTable::probe(key_t key, Entry& entry) const
+{
+  for (const auto& slot : bucket_get(key).slots)
+  {
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if (data and (slot.check.load(std::memory_order_relaxed) ^ data) == key)
+    {
+      entry = unpack(key, data);
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::store(key_t key, int depth, Bound bound, int score,
+                               CompactMove move)
+{
+  auto& slots = bucket_get(key).slots;
+  // Each search of age difference costs as much as 8 plies of depth
+  auto worth = [this](const Entry& e)
+  {
+    return e.depth - 8 * ((age_ - e.age) & 63);
+  };
+  Slot* replaced = nullptr;
+  Entry replaced_entry;
+  for (auto& slot : slots)
+  {
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    key_t slot_key = slot.check.load(std::memory_order_relaxed) ^ data;
+    Entry e = unpack(slot_key, data);
+    if (data and slot_key == key)
+    {
+      // Keep the best move of a previous search if there is none now
+      if (move == CompactMove::none())
+        move = e.move;
+      replaced = &slot;
+      break;
+    }
+    if (not replaced or worth(e) < worth(replaced_entry))
+    {
+      replaced = &slot;
+      replaced_entry = e;
+    }
+  }
+  Entry entry;
+  entry.key = key;
+  entry.score = score;
+  entry.move = move;
+  entry.depth = depth;
+  entry.bound = bound;
+  entry.age = age_;
+  uint64_t data = pack(entry);
+  replaced->check.store(key ^ data, std::memory_order_relaxed);
+  replaced->data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const
+{
+  size_t sampled = std::min<size_t>(bucket_count_, 1000 / bucket_size);
+  int used = 0;
+  for (size_t i = 0; i < sampled; ++i)
+    for (const auto& slot : buckets_[i].slots)
+    {
+      uint64_t data = slot.data.load(std::memory_order_relaxed);
+      key_t key = slot.check.load(std::memory_order_relaxed) ^ data;
+      used += data and unpack(key, data).age == age_;
+    }
+  return used * 1000 / (sampled * bucket_size);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "compact-move.hh"
+#include "zobrist.hh"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+** Results of previous searches, indexed by position key.
+**
+** The table holds a power of two number of 64 bytes buckets, one cache
+** line each, of four 16 bytes entries. A position may go in any entry of
+** the bucket its key selects. When the bucket is full, the entry with the
+** lowest depth, counting older searches as shallower, is replaced.
+**
+** Search threads share the table without locks. A slot keeps its data in
+** one word and the key xored with that word in the other, so that an entry
+** torn by two concurrent stores no longer matches its key and is ignored.
+*/
+class TranspositionTable
+{
+public:
+  using key_t = zobrist::key_t;
+
+  /* What the score tells about the value of the position */
+  enum Bound : uint8_t
+  {
+    EXACT,
+    LOWER, // value >= score, the search cut off
+    UPPER  // value <= score, no move raised alpha
+  };
+
+  struct Entry
+  {
+    key_t key;
+    int32_t score;
+    CompactMove move;
+    int8_t depth;
+    uint8_t bound : 2;
+    uint8_t age : 6;
+  };
+
+  static constexpr size_t default_megabytes = 32;
+
+  TranspositionTable(size_t megabytes = default_megabytes);
+
+  void resize(size_t megabytes);
+  void clear();
+  /* Entries stored before count as older from now on */
+  void new_search();
+
+  bool probe(key_t key, Entry& entry) const;
+  void store(key_t key, int depth, Bound bound, int score, CompactMove move);
+  /* Permille of the entries stored by the current search, sampled on the
+   * first thousand entries */
+  int hashfull() const;
+
+private:
+  static constexpr size_t bucket_size = 4;
+  struct Slot
+  {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+  };
+  struct alignas(64) Bucket
+  {
+    std::array<Slot, bucket_size> slots;
+  };
+  static_assert(sizeof(Slot) == 16, "Entries must pack in 16 bytes");
+  static_assert(sizeof(Bucket) == 64, "Buckets must fit a cache line");
+
+  /* Score in bits 0-31, move in 32-47, depth in 48-55, bound and age in
+   * 56-63 */
+  static uint64_t pack(const Entry& entry);
+  static Entry unpack(key_t key, uint64_t data);
+
+  Bucket& bucket_get(key_t key) const {
+    return buckets_[key & (bucket_count_ - 1)];
+  }
+
+  std::unique_ptr<char[]> memory_;
+  Bucket* buckets_;
+  size_t bucket_count_;
+  uint8_t age_ = 0;
+};
@@ -0,0 +1,206 @@
+#include "attacks.hh"
+
+namespace attacks
+{
+  bitboard_t pawn_table[2][64];
+  bitboard_t knight_table[64];
+  bitboard_t king_table[64];
+  Magic rook_magics[64];
+  Magic bishop_magics[64];
+  bitboard_t between_table[64][64];
+  bitboard_t line_table[64][64];
+
+  namespace
+  {
+    bitboard_t rook_table[0x19000];
+    bitboard_t bishop_table[0x1480];
+
+    const int rook_directions[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    const int bishop_directions[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+    bitboard_t step(square_t square, int d_file, int d_rank)
+    {
+      int file = bitboard::file_of(square) + d_file;
+      int rank = bitboard::rank_of(square) + d_rank;
+      if (file < 0 or 7 < file or rank < 0 or 7 < rank)
+        return bitboard::empty;
+      return bitboard::square_bb(bitboard::square_of(file, rank));
+    }
+
+    // Slow ray walk, only used to fill the tables
+    bitboard_t sliding_attacks(const int directions[4][2], square_t square,
+                               bitboard_t occupancy)
+    {
+      bitboard_t result = bitboard::empty;
+      for (int d = 0; d < 4; ++d)
+      {
+        int file = bitboard::file_of(square) + directions[d][0];
+        int rank = bitboard::rank_of(square) + directions[d][1];
+        for (; 0 <= file and file < 8 and 0 <= rank and rank < 8;
+             file += directions[d][0], rank += directions[d][1])
+        {
+          bitboard_t square_bb =
+            bitboard::square_bb(bitboard::square_of(file, rank));
+          result |= square_bb;
+          if (occupancy & square_bb)
+            break;
+        }
+      }
+      return result;
+    }
+
+    // xorshift64*, deterministic so that startup time does not vary
+    class Random
+    {
+    public:
+      Random(uint64_t seed)
+        : state_(seed)
+      {}
+
+      uint64_t next()
+      {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        return state_ * 2685821657736338717ULL;
+      }
+
+      uint64_t sparse()
+      {
+        return next() & next() & next();
+      }
+
+    private:
+      uint64_t state_;
+    };
+
+    void init_magics(const int directions[4][2], bitboard_t* table,
+                     Magic magics[64])
+    {
+      static bitboard_t occupancies[4096];
+      static bitboard_t references[4096];
+      static int epoch[4096];
+      int current_epoch = 0;
+      // Seeds per rank known to find magics quickly with this generator
+      const uint64_t seeds[8] = {728, 10316, 55013, 32803,
+                                 12281, 15100, 16645, 255};
+
+      for (square_t square = 0; square < 64; ++square)
+      {
+        // Board edges are not relevant blockers, unless on the piece's line
+        bitboard_t edges =
+          ((bitboard::rank_1 | bitboard::rank_8)
+           & ~(bitboard::rank_1 << (8 * bitboard::rank_of(square))))
+          | ((bitboard::file_a | bitboard::file_h)
+             & ~(bitboard::file_a << bitboard::file_of(square)));
+        Magic& m = magics[square];
+        m.mask = sliding_attacks(directions, square, bitboard::empty) & ~edges;
+        m.shift = 64 - bitboard::popcount(m.mask);
+        m.attacks = square == 0 ? table : magics[square - 1].attacks
+          + (1 << bitboard::popcount(magics[square - 1].mask));
+
+        // Carry-Rippler enumeration of every subset of the mask
+        int size = 0;
+        bitboard_t occupancy = bitboard::empty;
+        do
+        {
+          occupancies[size] = occupancy;
+          references[size] = sliding_attacks(directions, square, occupancy);
+          ++size;
+          occupancy = (occupancy - m.mask) & m.mask;
+        } while (occupancy);
+
+        Random random(seeds[bitboard::rank_of(square)]);
+        for (int i = 0; i < size;)
+        {
+          do
+            m.magic = random.sparse();
+          while (bitboard::popcount((m.magic * m.mask) >> 56) < 6);
+
+          ++current_epoch;
+          for (i = 0; i < size; ++i)
+          {
+            unsigned index = m.index(occupancies[i]);
+            if (epoch[index] < current_epoch)
+            {
+              epoch[index] = current_epoch;
+              m.attacks[index] = references[i];
+            }
+            else if (m.attacks[index] != references[i])
+              break;
+          }
+        }
+      }
+    }
+
+    struct Initializer
+    {
+      Initializer()
+      {
+        const int knight_steps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2},
+                                        {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+        for (square_t square = 0; square < 64; ++square)
+        {
+          pawn_table[0][square] = step(square, -1, 1) | step(square, 1, 1);
+          pawn_table[1][square] = step(square, -1, -1) | step(square, 1, -1);
+          knight_table[square] = bitboard::empty;
+          king_table[square] = bitboard::empty;
+          for (auto& s : knight_steps)
+            knight_table[square] |= step(square, s[0], s[1]);
+          for (int d_file = -1; d_file <= 1; ++d_file)
+            for (int d_rank = -1; d_rank <= 1; ++d_rank)
+              if (d_file or d_rank)
+                king_table[square] |= step(square, d_file, d_rank);
+        }
+        init_magics(rook_directions, rook_table, rook_magics);
+        init_magics(bishop_directions, bishop_table, bishop_magics);
+        for (square_t from = 0; from < 64; ++from)
+          for (square_t to = 0; to < 64; ++to)
+          {
+            bitboard_t to_bb = bitboard::square_bb(to);
+            between_table[from][to] = bitboard::empty;
+            line_table[from][to] = bitboard::empty;
+            if (from == to)
+              continue;
+            for (auto directions : {rook_directions, bishop_directions})
+            {
+              bitboard_t from_attacks =
+                sliding_attacks(directions, from, bitboard::empty);
+              if (not (from_attacks & to_bb))
+                continue;
+              bitboard_t to_attacks =
+                sliding_attacks(directions, to, bitboard::empty);
+              line_table[from][to] = (from_attacks & to_attacks)
+                | bitboard::square_bb(from) | to_bb;
+              between_table[from][to] =
+                sliding_attacks(directions, from, to_bb)
+                & sliding_attacks(directions, to, bitboard::square_bb(from));
+            }
+          }
+      }
+    };
+
+    Initializer initializer;
+  }
+
+  bitboard_t piece_attacks(plugin::PieceType type, plugin::Color color,
+                           square_t square, bitboard_t occupancy)
+  {
+    switch (type)
+    {
+      case plugin::PieceType::PAWN:
+        return pawn_attacks(color, square);
+      case plugin::PieceType::KNIGHT:
+        return knight_attacks(square);
+      case plugin::PieceType::BISHOP:
+        return bishop_attacks(square, occupancy);
+      case plugin::PieceType::ROOK:
+        return rook_attacks(square, occupancy);
+      case plugin::PieceType::QUEEN:
+        return queen_attacks(square, occupancy);
+      case plugin::PieceType::KING:
+        return king_attacks(square);
+    }
+    return bitboard::empty;
+  }
+}
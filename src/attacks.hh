@@ -0,0 +1,89 @@
+#pragma once
+
+#include "bitboard.hh"
+#include "plugin/color.hh"
+#include "plugin/piece-type.hh"
+
+/*
+** Precomputed attack tables.
+**
+** Knights, kings and pawns use a plain lookup by square. Rooks and bishops
+** use magic bitboards: the relevant blockers of the square are multiplied
+** by a magic number whose high bits give a perfect hash into the table of
+** attack sets. Queens combine both. The tables are filled once at startup.
+*/
+namespace attacks
+{
+  using bitboard::bitboard_t;
+  using bitboard::square_t;
+
+  struct Magic
+  {
+    bitboard_t mask;
+    bitboard_t magic;
+    bitboard_t* attacks;
+    unsigned shift;
+
+    unsigned index(bitboard_t occupancy) const
+    {
+      return ((occupancy & mask) * magic) >> shift;
+    }
+  };
+
+  extern bitboard_t pawn_table[2][64];
+  extern bitboard_t knight_table[64];
+  extern bitboard_t king_table[64];
+  extern Magic rook_magics[64];
+  extern Magic bishop_magics[64];
+  extern bitboard_t between_table[64][64];
+  extern bitboard_t line_table[64][64];
+
+  /* Squares attacked by a pawn of the given color standing on square */
+  inline bitboard_t pawn_attacks(plugin::Color color, square_t square)
+  {
+    return pawn_table[static_cast<bool>(color)][square];
+  }
+
+  inline bitboard_t knight_attacks(square_t square)
+  {
+    return knight_table[square];
+  }
+
+  inline bitboard_t king_attacks(square_t square)
+  {
+    return king_table[square];
+  }
+
+  inline bitboard_t rook_attacks(square_t square, bitboard_t occupancy)
+  {
+    const Magic& m = rook_magics[square];
+    return m.attacks[m.index(occupancy)];
+  }
+
+  inline bitboard_t bishop_attacks(square_t square, bitboard_t occupancy)
+  {
+    const Magic& m = bishop_magics[square];
+    return m.attacks[m.index(occupancy)];
+  }
+
+  inline bitboard_t queen_attacks(square_t square, bitboard_t occupancy)
+  {
+    return rook_attacks(square, occupancy) | bishop_attacks(square, occupancy);
+  }
+
+  /* Squares strictly between two aligned squares, empty otherwise */
+  inline bitboard_t between(square_t from, square_t to)
+  {
+    return between_table[from][to];
+  }
+
+  /* Whole line (rank, file or diagonal) through two aligned squares, empty
+   * otherwise */
+  inline bitboard_t line(square_t from, square_t to)
+  {
+    return line_table[from][to];
+  }
+
+  bitboard_t piece_attacks(plugin::PieceType type, plugin::Color color,
+                           square_t square, bitboard_t occupancy);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "plugin/position.hh"
+#include <cstdint>
+
+/*
+** Bitboard helpers.
+**
+** A bitboard is a set of squares stored in a 64 bits integer, bit n
+** representing the square n = rank * 8 + file (a1 = 0, h1 = 7, h8 = 63).
+*/
+namespace bitboard
+{
+  using bitboard_t = uint64_t;
+  using square_t = int;
+
+  constexpr bitboard_t empty = 0;
+  constexpr bitboard_t file_a = 0x0101010101010101ULL;
+  constexpr bitboard_t file_h = file_a << 7;
+  constexpr bitboard_t rank_1 = 0xFFULL;
+  constexpr bitboard_t rank_8 = rank_1 << 56;
+
+  constexpr bitboard_t square_bb(square_t square)
+  {
+    return 1ULL << square;
+  }
+
+  constexpr square_t square_of(int file, int rank)
+  {
+    return rank * 8 + file;
+  }
+
+  inline square_t square_of(plugin::Position position)
+  {
+    return square_of(static_cast<int>(position.file_get()),
+                     static_cast<int>(position.rank_get()));
+  }
+
+  inline plugin::Position position_of(square_t square)
+  {
+    return plugin::Position(static_cast<plugin::File>(square & 7),
+                            static_cast<plugin::Rank>(square >> 3));
+  }
+
+  constexpr int file_of(square_t square)
+  {
+    return square & 7;
+  }
+
+  constexpr int rank_of(square_t square)
+  {
+    return square >> 3;
+  }
+
+  inline int popcount(bitboard_t b)
+  {
+    return __builtin_popcountll(b);
+  }
+
+  /* Index of the least significant bit, b must not be empty */
+  inline square_t lsb(bitboard_t b)
+  {
+    return __builtin_ctzll(b);
+  }
+
+  inline square_t pop_lsb(bitboard_t& b)
+  {
+    square_t square = lsb(b);
+    b &= b - 1;
+    return square;
+  }
+
+  constexpr bool more_than_one(bitboard_t b)
+  {
+    return b & (b - 1);
+  }
+}
@@ -1,22 +1,283 @@
 #include "chessboard.hh"
+#include "attacks.hh"
 #include "rule-checker.hh"
 #include "plugin-auxiliary.hh"
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <sstream>
 #include <thread>
 /*std::ostream& operator<<(std::ostream& o, const plugin::Position& p);*/
 
 ChessBoard::ChessBoard()
   : last_move_(nullptr)
-{}
+{
+  init_pieces();
+}
 
 ChessBoard::ChessBoard(std::vector<plugin::Listener*> listeners)
   : last_move_(nullptr), listeners_(listeners)
 {
+  init_pieces();
 }
 
 ChessBoard::ChessBoard(const ChessBoard& board)
-  : board_(board.board_)
 {
+  *this = board;
+}
+
+ChessBoard& ChessBoard::operator=(const ChessBoard& board)
+{
+  board_ = board.board_;
+  pieces_ = board.pieces_;
+  colors_ = board.colors_;
+  occupancy_ = board.occupancy_;
+  piece_list_ = board.piece_list_;
+  piece_count_ = board.piece_count_;
+  piece_index_ = board.piece_index_;
+  attacks_from_ = board.attacks_from_;
+  attack_count_ = board.attack_count_;
+  attacked_ = board.attacked_;
+  material_ = board.material_;
+  psqt_middle_ = board.psqt_middle_;
+  psqt_end_ = board.psqt_end_;
+  phase_ = board.phase_;
+  observer_ = nullptr;
+  last_move_ = board.last_move_;
+  key_ = board.key_;
+  pawn_key_ = board.pawn_key_;
+  side_to_move_ = board.side_to_move_;
+  castling_rights_ = board.castling_rights_;
+  en_passant_ = board.en_passant_;
+  previous_keys_ = board.previous_keys_;
+  inactive_turn = board.inactive_turn;
+  return *this;
+}
+
+ChessBoard::ChessBoard(const std::string& fen)
+  : last_move_(nullptr)
+{
+  std::istringstream input(fen);
+  std::string placement, side, castling, en_passant;
+  int halfmove = 0;
+  if (not (input >> placement >> side >> castling >> en_passant))
+    throw std::invalid_argument("Invalid FEN: " + fen);
+  input >> halfmove;
+
+  const std::string letters = "KQRBNP";
+  // The piece lists have room for a bounded number of pieces of a type
+  std::array<std::array<size_t, 6>, 2> counts = {};
+  int file = 0;
+  int rank = 7;
+  for (char c : placement)
+  {
+    if (c == '/')
+    {
+      if (file != 8 or rank == 0)
+        throw std::invalid_argument("Invalid FEN: " + fen);
+      file = 0;
+      --rank;
+    }
+    else if ('1' <= c and c <= '8' and file + c - '0' <= 8)
+      for (int n = c - '0'; n > 0; --n)
+        board_[7 - rank][file++] = 0x7;
+    else if (letters.find(toupper(c)) != std::string::npos and file < 8)
+    {
+      // Pieces away from their initial squares have moved, castling rights
+      // clear the flag of kings and rooks below
+      cell_t type = letters.find(toupper(c));
+      bool black = islower(c);
+      if (++counts[black][type] > std::tuple_size<piece_list_t>::value
+          or (type == 5 and (rank == 0 or rank == 7)))
+        throw std::invalid_argument("Invalid FEN: " + fen);
+      cell_t moved = 0x8;
+      if (type == 5 and rank == (black ? 6 : 1))
+        moved = 0;
+      board_[7 - rank][file++] = (black << 7) | moved | type;
+    }
+    else
+      throw std::invalid_argument("Invalid FEN: " + fen);
+  }
+  if (file != 8 or rank != 0)
+    throw std::invalid_argument("Invalid FEN: " + fen);
+
+  castling_rights_ = 0;
+  if (castling != "-")
+    for (char c : castling)
+    {
+      auto right = std::string("KQkq").find(c);
+      if (right == std::string::npos)
+        throw std::invalid_argument("Invalid FEN: " + fen);
+      bool black = right >= 2;
+      bool king_side = right % 2 == 0;
+      auto color = static_cast<plugin::Color>(black);
+      plugin::Position king = initial_king_position(color);
+      plugin::Position rook = initial_rook_position(color, king_side);
+      if (get_square(king) != ((black << 7) | 0x8)
+          and get_square(king) != (black << 7))
+        continue;
+      if ((get_square(rook) & 0b10000111) != ((black << 7) | 0x2))
+        continue;
+      board_[7 - ~king.rank_get()][~king.file_get()] &= ~0x8;
+      board_[7 - ~rook.rank_get()][~rook.file_get()] &= ~0x8;
+      castling_rights_ |= 1 << right;
+    }
+  init_pieces();
+  if (piece_count_[0][0] != 1 or piece_count_[1][0] != 1)
+    throw std::invalid_argument("Invalid FEN: " + fen);
+
+  if (side == "b")
+  {
+    side_to_move_ = plugin::Color::BLACK;
+    key_ ^= zobrist::side;
+  }
+  else if (side != "w")
+    throw std::invalid_argument("Invalid FEN: " + fen);
+  if (en_passant != "-")
+  {
+    if (en_passant.size() != 2 or en_passant[0] < 'a' or 'h' < en_passant[0]
+        or (en_passant[1] != '3' and en_passant[1] != '6'))
+      throw std::invalid_argument("Invalid FEN: " + fen);
+    en_passant_set(bitboard::square_of(en_passant[0] - 'a',
+          en_passant[1] - '1'));
+  }
+  inactive_turn = halfmove;
+}
+
+void ChessBoard::init_pieces()
+{
+  for (auto& color_pieces : pieces_)
+    color_pieces.fill(bitboard::empty);
+  colors_.fill(bitboard::empty);
+  occupancy_ = bitboard::empty;
+  for (auto& color_counts : piece_count_)
+    color_counts.fill(0);
+  attacks_from_.fill(bitboard::empty);
+  for (auto& color_counts : attack_count_)
+    color_counts.fill(0);
+  attacked_.fill(bitboard::empty);
+  material_.fill(0);
+  psqt_middle_.fill(0);
+  psqt_end_.fill(0);
+  phase_ = 0;
+  key_ = zobrist::castling[castling_rights_];
+  pawn_key_ = 0;
+  for (bitboard::square_t square = 0; square < 64; ++square)
+    piece_toggle(square, get_square(bitboard::position_of(square)));
+  // Sliders placed early saw through the squares filled after them
+  for (bitboard_t b = occupancy_; b;)
+    sliders_update(bitboard::pop_lsb(b));
+}
+
+// Adds or removes (xor) the piece stored in the cell value on square, in the
+// bitboards, the piece lists, the attack maps, the evaluation sums and the
+// key, and tells the observer. The sliders whose rays cross the square
+// are left to sliders_update.
+void ChessBoard::piece_toggle(bitboard::square_t square, cell_t value)
+{
+  cell_t type = value & 0b00000111;
+  if (type == 0b00000111)
+    return;
+  bool color = value & 0b10000000;
+  bitboard_t square_bb = bitboard::square_bb(square);
+  auto& list = piece_list_[color][type];
+  auto& count = piece_count_[color][type];
+  int sign = 1;
+  if (pieces_[color][type] & square_bb)
+  { // The last square of the list takes the place of the removed one
+    uint8_t last = list[--count];
+    piece_index_[last] = piece_index_[square];
+    list[piece_index_[square]] = last;
+    attacks_remove(color, attacks_from_[square]);
+    attacks_from_[square] = bitboard::empty;
+    sign = -1;
+  }
+  else
+  {
+    piece_index_[square] = count;
+    list[count++] = square;
+  }
+  pieces_[color][type] ^= square_bb;
+  colors_[color] ^= square_bb;
+  occupancy_ ^= square_bb;
+  key_ ^= zobrist::pieces[color][type][square];
+  if (type == 5)
+    pawn_key_ ^= zobrist::pieces[color][type][square];
+  material_[color] += sign * piece_square::material[type];
+  psqt_middle_[color] += sign * piece_square::value_get(piece_square::middle,
+      color, type, square);
+  psqt_end_[color] += sign * piece_square::value_get(piece_square::end,
+      color, type, square);
+  phase_ += sign * piece_square::phase_weight[type];
+  if (observer_)
+    observer_->piece_changed(color, type, square, sign > 0);
+  if (pieces_[color][type] & square_bb)
+  {
+    attacks_from_[square] = attacks::piece_attacks(
+        plugin::piecetype_array()[type], static_cast<plugin::Color>(color),
+        square, occupancy_);
+    attacks_add(color, attacks_from_[square]);
+  }
+}
+
+void ChessBoard::observer_set(PieceObserver* observer)
+{
+  observer_ = observer;
+  if (not observer_)
+    return;
+  for (bool color : {false, true})
+    for (int type = 0; type < 6; ++type)
+      for (int n = 0; n < piece_count_[color][type]; ++n)
+        observer_->piece_changed(color, type, piece_list_[color][type][n],
+                                 true);
+}
+
+// Sliders seeing a square that was just emptied or filled now go through it
+// or stop on it, only the part of their rays beyond the square changes
+void ChessBoard::sliders_update(bitboard::square_t square)
+{
+  bitboard_t square_bb = bitboard::square_bb(square);
+  bitboard_t rooks = pieces_[0][1] | pieces_[0][2] | pieces_[1][1]
+    | pieces_[1][2];
+  bitboard_t bishops = pieces_[0][1] | pieces_[0][3] | pieces_[1][1]
+    | pieces_[1][3];
+  bitboard_t sliders = ((attacks::rook_attacks(square, occupancy_) & rooks)
+      | (attacks::bishop_attacks(square, occupancy_) & bishops)) & ~square_bb;
+  while (sliders)
+  {
+    bitboard::square_t slider = bitboard::pop_lsb(sliders);
+    bitboard_t slider_bb = bitboard::square_bb(slider);
+    bool slider_color = colors_[1] & slider_bb;
+    bitboard_t attacks = bitboard::empty;
+    if (rooks & slider_bb)
+      attacks |= attacks::rook_attacks(slider, occupancy_);
+    if (bishops & slider_bb)
+      attacks |= attacks::bishop_attacks(slider, occupancy_);
+    bitboard_t changed = attacks ^ attacks_from_[slider];
+    attacks_remove(slider_color, attacks_from_[slider] & changed);
+    attacks_add(slider_color, attacks & changed);
+    attacks_from_[slider] = attacks;
+  }
+}
+
+void ChessBoard::attacks_add(bool color, bitboard_t squares)
+{
+  while (squares)
+  {
+    bitboard::square_t square = bitboard::pop_lsb(squares);
+    if (attack_count_[color][square]++ == 0)
+      attacked_[color] |= bitboard::square_bb(square);
+  }
+}
+
+void ChessBoard::attacks_remove(bool color, bitboard_t squares)
+{
+  while (squares)
+  {
+    bitboard::square_t square = bitboard::pop_lsb(squares);
+    if (--attack_count_[color][square] == 0)
+      attacked_[color] &= ~bitboard::square_bb(square);
+  }
 }
 
 int ChessBoard::update(std::shared_ptr<Move> move_ptr)
@@ -51,10 +312,7 @@ int ChessBoard::update(std::shared_ptr<Move> move_ptr)
         piecetype_eaten = piecetype_get(quiet_move.end_get()).value();
     }
   }
-  previous_states_.push_back(board_);
   apply_move(move);
-  if (en_passant)
-    set_square(position_piece_eaten_en_passant, 0x7);
 
   if (RuleChecker::isCheck(*this, get_king_position(move.color_get())))
   {
@@ -69,10 +327,6 @@ int ChessBoard::update(std::shared_ptr<Move> move_ptr)
   if (move.move_type_get() == Move::Type::QUIET)
   {
     const QuietMove& quiet_move = static_cast<const QuietMove&>(move);
-    if (quiet_move.piecetype_get() == plugin::PieceType::PAWN or quiet_move.is_an_attack())
-      inactive_turn = 0;
-    else
-      ++inactive_turn;
     for (auto l : listeners_)
       l->on_piece_moved(quiet_move.piecetype_get(), quiet_move.start_get(),
           quiet_move.end_get());
@@ -90,7 +344,6 @@ int ChessBoard::update(std::shared_ptr<Move> move_ptr)
   }
   else /* Castling */
   {
-    ++inactive_turn;
     plugin::Position king_start_position =
       initial_king_position(move.color_get());
     plugin::Position king_end_position = castling_king_end_position(
@@ -140,92 +393,175 @@ int ChessBoard::update(std::shared_ptr<Move> move_ptr)
   return 0;
 }
 
-bool ChessBoard::three_fold_repetition()
+bool ChessBoard::three_fold_repetition() const
+{
+  return repetition(2);
+}
+
+// Only positions since the last pawn move or capture can repeat, and only
+// every other ply with the same side to move
+bool ChessBoard::repetition(int times) const
 {
   int counter = 0;
-  for (auto previous : previous_states_) {
-    if (previous == board_) {
-      if (counter == 1)
-        return true;
-      ++counter;
-    }
+  int size = previous_keys_.size();
+  int reversible = std::min<int>(inactive_turn, size);
+  for (int ply = 4; ply <= reversible; ply += 2) {
+    if (previous_keys_[size - ply] == key_ and ++counter == times)
+      return true;
   }
   return false;
+}
 
+void ChessBoard::apply_move(const Move& move)
+{
+  apply_move(compact_get(move));
 }
 
-short ChessBoard::apply_move(const Move& move)
+void ChessBoard::apply_move(CompactMove move)
 {
-  if (move.move_type_get() == Move::Type::QUIET)
+  Undo undo;
+  apply_move(move, undo);
+}
+
+void ChessBoard::apply_move(CompactMove move, Undo& undo)
+{
+  bitboard::square_t from = move.from_get();
+  bitboard::square_t to = move.to_get();
+  plugin::Position start = bitboard::position_of(from);
+  plugin::Position end = bitboard::position_of(to);
+  cell_t source_square = get_square(start);
+  //std::cerr << "source_square :" << std::hex << source_square << std::endl;
+  undo.key = key_;
+  undo.en_passant = en_passant_;
+  undo.moved = source_square;
+  undo.captured = get_square(end);
+  undo.castling_rights = castling_rights_;
+  undo.inactive_turn = inactive_turn;
+
+  previous_keys_.push_back(key_);
+  side_to_move_ = !side_to_move_;
+  key_ ^= zobrist::side ^ zobrist::castling[castling_rights_];
+  en_passant_set(-1);
+  auto color = static_cast<plugin::Color>(source_square >> 7);
+  if (move.is_castling())
   {
-    const QuietMove& quiet_move = static_cast<const QuietMove&>(move);
-    cell_t source_square = get_square(quiet_move.start_get());
-    //std::cerr << "source_square :" << std::hex << source_square << std::endl;
-    cell_t destination_square = get_square(quiet_move.end_get());
-    if (quiet_move.is_promotion()) {
-      set_square(quiet_move.end_get(), (static_cast<bool>(move.color_get()) << 7) | 0x8 | quiet_move.promotion_piecetype_get());
-      set_square(quiet_move.start_get(), 0x7); // 0b000001111
+    bool king_side = move.flags_get() == CompactMove::KING_CASTLING;
+    plugin::Position rook = initial_rook_position(color, king_side);
+    undo.captured = get_square(rook);
+    //Moving King
+    move_piece(start, end);
+    // Moving Rook
+    move_piece(rook, castling_rook_end_position(color, king_side));
+  }
+  else
+  {
+    if (move.flags_get() == CompactMove::EN_PASSANT)
+      set_square(plugin::Position(end.file_get(), start.rank_get()), 0x7);
+    if (move.is_promotion()) {
+      set_square(end, (source_square & 0b10000000) | 0x8 | move.promotion_piecetype_get());
+      set_square(start, 0x7); // 0b000001111
     }
     else
-      move_piece(quiet_move.start_get(), quiet_move.end_get());
-    short ret = (static_cast<short>(source_square) << 8) | destination_square;
-    //std::cerr << "generating token : " << std::hex << ret << std::endl;
-    return ret;
+      move_piece(start, end);
+    if (move.flags_get() == CompactMove::DOUBLE_PUSH)
+      en_passant_set((from + to) / 2);
   }
-  else /* Castling */
+  // Castling moves the king from its initial cell, removing both rights
+  castling_rights_ &= castling_rights_kept(from) & castling_rights_kept(to);
+  bool pawn = (source_square & 0b00000111) == 0x5;
+  inactive_turn = (pawn or move.is_capture()) ? 0 : inactive_turn + 1;
+  key_ ^= zobrist::castling[castling_rights_];
+}
+
+// Takes back the last move applied, undo being the record it filled
+void ChessBoard::undo_move(CompactMove move, const Undo& undo)
+{
+  plugin::Position start = bitboard::position_of(move.from_get());
+  plugin::Position end = bitboard::position_of(move.to_get());
+  if (move.is_castling())
   {
-    //Moving King
-    move_piece(initial_king_position(move.color_get()),
-        castling_king_end_position(move.color_get(),
-          move.move_type_get() ==
-          Move::Type::KING_CASTLING));
-    // Moving Rook
-    move_piece(
-        initial_rook_position(move.color_get(),
-          move.move_type_get() == Move::Type::KING_CASTLING),
-        castling_rook_end_position(
-          move.color_get(), move.move_type_get() == Move::Type::KING_CASTLING));
-    return 0;
+    auto color = static_cast<plugin::Color>(undo.moved >> 7);
+    bool king_side = move.flags_get() == CompactMove::KING_CASTLING;
+    set_square(end, 0x7);
+    set_square(castling_rook_end_position(color, king_side), 0x7);
+    set_square(initial_rook_position(color, king_side), undo.captured);
   }
+  else
+    set_square(end, undo.captured);
+  // The pawn taken en passant has moved two squares
+  if (move.flags_get() == CompactMove::EN_PASSANT)
+    set_square(plugin::Position(end.file_get(), start.rank_get()),
+        (~undo.moved & 0b10000000) | 0x8 | 0x5);
+  set_square(start, undo.moved);
+  side_to_move_ = !side_to_move_;
+  castling_rights_ = undo.castling_rights;
+  en_passant_ = undo.en_passant;
+  inactive_turn = undo.inactive_turn;
+  key_ = undo.key;
+  previous_keys_.pop_back();
 }
 
-void ChessBoard::undo_move(const Move& move, short token)
+// Positions before a null move do not count for repetitions
+void ChessBoard::apply_null_move(Undo& undo)
 {
-  //std::cerr << "Undoing " << move << std::endl;
-  if (move.move_type_get() == Move::Type::QUIET)
+  undo.key = key_;
+  undo.en_passant = en_passant_;
+  undo.inactive_turn = inactive_turn;
+  previous_keys_.push_back(key_);
+  side_to_move_ = !side_to_move_;
+  key_ ^= zobrist::side;
+  en_passant_set(-1);
+  inactive_turn = 0;
+}
+
+void ChessBoard::undo_null_move(const Undo& undo)
+{
+  side_to_move_ = !side_to_move_;
+  en_passant_ = undo.en_passant;
+  inactive_turn = undo.inactive_turn;
+  key_ = undo.key;
+  previous_keys_.pop_back();
+}
+
+// The en passant square only counts in the key when a pawn can take on it
+void ChessBoard::en_passant_set(bitboard::square_t square)
+{
+  if (en_passant_ != -1)
+    key_ ^= zobrist::en_passant[bitboard::file_of(en_passant_)];
+  en_passant_ = -1;
+  if (square == -1)
+    return;
+  // Color of the pawn that just moved, black ones skip the sixth rank
+  bool color = bitboard::rank_of(square) == 5;
+  bitboard_t takers = pieces_[!color][5];
+  if (attacks::pawn_attacks(static_cast<plugin::Color>(color), square) & takers)
   {
-    const QuietMove& quiet_move = static_cast<const QuietMove&>(move);
-    if (quiet_move.is_promotion()) {
-      set_square(quiet_move.start_get(), (static_cast<bool>(move.color_get()) << 7)  | 0x8 | 0x5);
-      set_square(quiet_move.end_get(), token); // 0b000001111
-    }
-    else {
-      //pretty_print();
-      //std::cerr << "setting sqaure.." << std::endl;
-      //move_piece(quiet_move.start_get(), quiet_move.end_get());
-      //std::cerr << "token = " << std::hex << token << std::endl;
-      set_square(quiet_move.start_get(), static_cast<char>(token >> 8));
-      set_square(quiet_move.end_get(), static_cast<char>(token));
-      //pretty_print();
-    }
+    en_passant_ = square;
+    key_ ^= zobrist::en_passant[bitboard::file_of(square)];
   }
-  else /* Castling */
+}
+
+unsigned char ChessBoard::castling_rights_kept(bitboard::square_t square)
+{
+  switch (square)
   {
-    //Moving King
-    move_piece(initial_king_position(move.color_get()),
-        castling_king_end_position(move.color_get(),
-          move.move_type_get() ==
-          Move::Type::KING_CASTLING));
-    // Moving Rook
-    move_piece(
-        initial_rook_position(move.color_get(),
-          move.move_type_get() == Move::Type::KING_CASTLING),
-        castling_rook_end_position(
-          move.color_get(), move.move_type_get() == Move::Type::KING_CASTLING));
+    case bitboard::square_of(0, 0):
+      return ~0b0010;
+    case bitboard::square_of(4, 0):
+      return ~0b0011;
+    case bitboard::square_of(7, 0):
+      return ~0b0001;
+    case bitboard::square_of(0, 7):
+      return ~0b1000;
+    case bitboard::square_of(4, 7):
+      return ~0b1100;
+    case bitboard::square_of(7, 7):
+      return ~0b0100;
+    default:
+      return all_castling_rights;
   }
 }
 
-
 void ChessBoard::move_piece(plugin::Position start, plugin::Position end)
 {
   cell_t moving_piece = get_square(start);
@@ -358,8 +694,15 @@ void ChessBoard::animate(const Move& move) const
 
 void ChessBoard::set_square(plugin::Position position, cell_t value)
 {
-  board_[7 - static_cast<char>(position.rank_get())]
-    [static_cast<char>(position.file_get())] = value;
+  cell_t& cell = board_[7 - static_cast<char>(position.rank_get())]
+    [static_cast<char>(position.file_get())];
+  bitboard::square_t square = bitboard::square_of(position);
+  bitboard_t occupancy = occupancy_;
+  piece_toggle(square, cell);
+  piece_toggle(square, value);
+  if (occupancy != occupancy_)
+    sliders_update(square);
+  cell = value;
 }
 
 ChessBoard::cell_t ChessBoard::get_square(plugin::Position position) const
@@ -381,7 +724,8 @@ bool ChessBoard::has_moved(plugin::Position position) const
 
 plugin::Color ChessBoard::color_get(plugin::Position position) const
 {
-  return static_cast<plugin::Color>(get_opt(position, 0b10000000) != 0);
+  bitboard_t square_bb = bitboard::square_bb(bitboard::square_of(position));
+  return static_cast<plugin::Color>((colors_[1] & square_bb) != 0);
 }
 
 bool ChessBoard::castleflag_get(plugin::Position position) const
@@ -394,222 +738,320 @@ bool ChessBoard::castleflag_get(plugin::Position position) const
 bool ChessBoard::is_attacked(plugin::Color color,
     plugin::Position current_cell) const
 {
-  /*auto moves = get_possible_actions(!color);
-    for (auto move : moves) {
-    if (move->move_type_get() == Move::Type::QUIET)
+  return attacked_[!static_cast<bool>(color)]
+    & bitboard::square_bb(bitboard::square_of(current_cell));
+}
+
+// Pieces of both colors attacking square, sliders see through occupancy
+ChessBoard::bitboard_t ChessBoard::attackers_to(bitboard::square_t square,
+    bitboard_t occupancy) const
+{
+  using plugin::PieceType;
+  bitboard_t rooks = pieces_bb(PieceType::ROOK) | pieces_bb(PieceType::QUEEN);
+  bitboard_t bishops = pieces_bb(PieceType::BISHOP)
+    | pieces_bb(PieceType::QUEEN);
+  return (attacks::pawn_attacks(plugin::Color::BLACK, square)
+      & pieces_bb(plugin::Color::WHITE, PieceType::PAWN))
+    | (attacks::pawn_attacks(plugin::Color::WHITE, square)
+      & pieces_bb(plugin::Color::BLACK, PieceType::PAWN))
+    | (attacks::knight_attacks(square) & pieces_bb(PieceType::KNIGHT))
+    | (attacks::king_attacks(square) & pieces_bb(PieceType::KING))
+    | (attacks::rook_attacks(square, occupancy) & rooks)
+    | (attacks::bishop_attacks(square, occupancy) & bishops);
+}
+
+std::vector<std::shared_ptr<Move>> ChessBoard::get_possible_actions(plugin::Color playing_color) const
+{
+  std::vector<std::shared_ptr<Move>> moves;
+  MoveList list;
+  generate_moves(playing_color, list);
+  for (auto move : list)
+    moves.push_back(move_get(move));
+  return moves;
+}
+
+// Only legal moves are generated: the checkers and the pinned pieces are
+// computed once, then every piece is restricted to the squares that block or
+// take a single checker, and pinned pieces to the line of their pin.
+void ChessBoard::generate_moves(plugin::Color playing_color,
+    MoveList& moves, GenType type) const
+{
+  bool color = static_cast<bool>(playing_color);
+  bitboard_t own = colors_[color];
+  bitboard_t opponents = colors_[!color];
+  bool captures_only = type == GenType::CAPTURES;
+  bool quiets_only = type == GenType::QUIETS;
+  bitboard_t kind = captures_only ? opponents
+    : quiets_only ? ~occupancy_ : ~own;
+  bitboard::square_t king = piece_list_[color][0][0];
+  bitboard_t checkers = bitboard::empty;
+  if (attacked_[!color] & bitboard::square_bb(king))
+    checkers = attackers_to(king, occupancy_) & opponents;
+
+  // King moves, the squares behind the king on the ray of a slider giving
+  // check are not in the attack map but are attacked once the king moves
+  bitboard_t danger = attacked_[!color];
+  for (bitboard_t b = checkers & ~pieces_[!color][4] & ~pieces_[!color][5];
+       b;)
+  {
+    bitboard::square_t checker = bitboard::pop_lsb(b);
+    danger |= attacks::line(king, checker)
+      & ~attacks::between(king, checker) & ~bitboard::square_bb(checker);
+  }
+  for (bitboard_t b = attacks::king_attacks(king) & kind & ~danger; b;)
+  {
+    bitboard::square_t to = bitboard::pop_lsb(b);
+    moves.push(CompactMove(king, to, (opponents & bitboard::square_bb(to))
+          ? CompactMove::CAPTURE : CompactMove::QUIET));
+  }
+  if (bitboard::more_than_one(checkers))
+    return;
+
+  bitboard_t targets = ~own;
+  if (checkers)
+    targets = attacks::between(king, bitboard::lsb(checkers)) | checkers;
+  bitboard_t pinned = pinned_bb(playing_color);
+
+  // Pawns
+  bitboard::square_t up = color ? -8 : 8;
+  bitboard_t promotion_rank = color ? bitboard::rank_1 : bitboard::rank_8;
+  bitboard_t double_push_rank = color ? bitboard::rank_1 << 40
+    : bitboard::rank_1 << 16;
+  for (bitboard_t pawns = pieces_[color][5]; pawns;)
+  {
+    bitboard::square_t from = bitboard::pop_lsb(pawns);
+    bitboard_t allowed = targets;
+    if (pinned & bitboard::square_bb(from))
+      allowed &= attacks::line(king, from);
+    bitboard_t push = bitboard::square_bb(from + up) & ~occupancy_;
+    bitboard_t double_push = bitboard::empty;
+    if (push & double_push_rank)
+      double_push = bitboard::square_bb(from + 2 * up) & ~occupancy_
+        & allowed;
+    push &= allowed;
+    bitboard_t captures = attacks::pawn_attacks(playing_color, from)
+      & opponents & allowed;
+    if ((push | captures) & promotion_rank)
     {
-    QuietMove& quiet_move = static_cast<QuietMove&>(*move);
-    if (quiet_move.end_get() == current_cell)
-    return true;
+      if (quiets_only)
+        continue;
+      for (bitboard_t b = push | captures; b;)
+      {
+        bitboard::square_t to = bitboard::pop_lsb(b);
+        uint16_t flags = (captures & bitboard::square_bb(to))
+          ? CompactMove::PROMOTION_CAPTURE : CompactMove::PROMOTION;
+        for (uint16_t piece = 0; piece < 4; ++piece)
+          moves.push(CompactMove(from, to, flags | piece));
+      }
+      continue;
     }
+    if (not captures_only)
+    {
+      if (push)
+        moves.push(CompactMove(from, from + up));
+      if (double_push)
+        moves.push(CompactMove(from, from + 2 * up,
+              CompactMove::DOUBLE_PUSH));
     }
-    return false;*/
-  /*auto opponent_color = !color;
-  for (int i = 0; i < 8; ++i)
-    for (int j = 0; j < 8; ++j)
+    if (quiets_only)
+      continue;
+    while (captures)
+      moves.push(CompactMove(from, bitboard::pop_lsb(captures),
+            CompactMove::CAPTURE));
+    // En passant removes two pawns from a rank, it may uncover the king
+    if (en_passant_ != -1
+        and attacks::pawn_attacks(playing_color, from)
+        & bitboard::square_bb(en_passant_))
     {
-      plugin::Position pos(static_cast<plugin::File>(i), static_cast<plugin::Rank>(j));
-      for (auto m: get_possible_actions(opponent_color, pos))
-        if (m->move_type_get() == Move::Type::QUIET and static_cast<QuietMove&>(*m).end_get() == current_cell)
-          return true;
-    }*/
-
-  for (int j = 0; j < 8; ++j)
-    for (int i = 0; i < 8; ++i)
+      CompactMove move(from, en_passant_, CompactMove::EN_PASSANT);
+      if (is_legal(move))
+        moves.push(move);
+    }
+  }
+
+  // Pieces
+  for (int type = 1; type < 5; ++type)
+  {
+    for (bitboard_t pieces = pieces_[color][type]; pieces;)
     {
-      plugin::Position pos(static_cast<plugin::File>(i),
-          static_cast<plugin::Rank>(j));
-      if (piecetype_get(pos) != std::experimental::nullopt and
-          color_get(pos) != color)
+      bitboard::square_t from = bitboard::pop_lsb(pieces);
+      bitboard_t b = attacks::piece_attacks(plugin::piecetype_array()[type],
+          playing_color, from, occupancy_) & targets & kind;
+      if (pinned & bitboard::square_bb(from))
+        b &= attacks::line(king, from);
+      while (b)
       {
-        QuietMove move(!color, pos,
-            current_cell, piecetype_get(pos).value(), true, true);
-        if (RuleChecker::is_move_valid(*this, move))
-        {
-          return true;
-        }
+        bitboard::square_t to = bitboard::pop_lsb(b);
+        moves.push(CompactMove(from, to, (opponents & bitboard::square_bb(to))
+              ? CompactMove::CAPTURE : CompactMove::QUIET));
       }
     }
-  return false;
+  }
+
+  // Castling
+  if (checkers or captures_only)
+    return;
+  for (int king_side = 1; king_side >= 0; --king_side)
+  {
+    unsigned char right = 1 << (2 * color + !king_side);
+    if (not (castling_rights_ & right))
+      continue;
+    bitboard::square_t rook = bitboard::square_of(
+        initial_rook_position(playing_color, king_side));
+    if (king != bitboard::square_of(initial_king_position(playing_color))
+        or not (pieces_[color][2] & bitboard::square_bb(rook))
+        or (attacks::between(king, rook) & occupancy_))
+      continue;
+    CompactMove move(king, bitboard::square_of(
+          castling_king_end_position(playing_color, king_side)),
+        king_side ? CompactMove::KING_CASTLING : CompactMove::QUEEN_CASTLING);
+    if (is_legal(move))
+      moves.push(move);
+  }
 }
 
-std::vector<std::shared_ptr<Move>> ChessBoard::get_possible_actions(plugin::Color playing_color) const
+// Pieces of color standing alone between their king and an enemy slider
+ChessBoard::bitboard_t ChessBoard::pinned_bb(plugin::Color color) const
 {
-  std::vector<std::shared_ptr<Move>> moves;
-  for (char i = 0; i < 8; ++i)
+  bool c = static_cast<bool>(color);
+  bitboard::square_t king = bitboard::lsb(pieces_[c][0]);
+  bitboard_t snipers =
+    (attacks::rook_attacks(king, bitboard::empty)
+     & (pieces_[!c][1] | pieces_[!c][2]))
+    | (attacks::bishop_attacks(king, bitboard::empty)
+       & (pieces_[!c][1] | pieces_[!c][3]));
+  bitboard_t pinned = bitboard::empty;
+  while (snipers)
   {
-    for (char j = 0; j < 8; ++j)
-    {
-      auto file = static_cast<plugin::File>(i);
-      auto rank = static_cast<plugin::Rank>(j);
-      plugin::Position pos(file, rank);
-      auto pos_moves = get_possible_actions(playing_color, pos);
-      moves.insert(moves.end(), pos_moves.begin(), pos_moves.end());
-    }
+    bitboard_t blockers = attacks::between(king, bitboard::pop_lsb(snipers))
+      & occupancy_;
+    if (not bitboard::more_than_one(blockers))
+      pinned |= blockers & colors_[c];
   }
-  return moves;
+  return pinned;
 }
 
-
-std::vector<std::shared_ptr<Move>> ChessBoard::get_possible_actions(plugin::Color playing_color, plugin::Position position) const
+// Whether the move can be played by the side to move, ignoring the safety of
+// its king. Used for moves that do not come from the generator.
+bool ChessBoard::is_pseudo_legal(CompactMove move) const
 {
-  std::vector<std::shared_ptr<Move>> moves;
-  auto file = position.file_get();
-  auto rank = position.rank_get();
-  char dir = (playing_color == plugin::Color::WHITE) ? 1 : -1;
-  auto color_piece = color_get(position);
-  if (color_piece != playing_color)
-    return moves;
-  if (piecetype_get(position) == std::experimental::nullopt)
-    return moves;
-  plugin::PieceType piece_type = piecetype_get(position).value();
-
-  switch (piece_type)
-  {
-    case plugin::PieceType::KING:
-      {
-        for (int i = -1; i <= 1; i++)
-        {
-          for (int j = -1; j <= 1; j++)
-          {
-            if (i + ~file < 0 or 7 < ~file + i or ~rank + j < 0 or 7 < ~rank +j)
-              continue;
-            plugin::Position end_pos(static_cast<plugin::File>(~file + i), static_cast<plugin::Rank>(~rank + j));
-            push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-          }
-        }
-        Move KingCastle(Move::Type::KING_CASTLING,color_piece);
-        if(RuleChecker::is_move_valid(*this, KingCastle))
-          moves.push_back(std::make_shared<Move>(KingCastle));
-        Move QueenCastle(Move::Type::QUEEN_CASTLING,color_piece);
-        if(RuleChecker::is_move_valid(*this, QueenCastle))
-          moves.push_back(std::make_shared<Move>(QueenCastle));
-        break;
-      }
-
-    case plugin::PieceType::QUEEN:
-      {
-        for (int i = 0; i < 8; i++)
-        {
-          if (i != ~file) {
-            plugin::Position end_pos(static_cast<plugin::File>(i), rank);
-            push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-          }
-          if (i != ~rank) {
-            plugin::Position end_pos(file, static_cast<plugin::Rank>(i));
-            push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-          }
-        }
-        for (int j = 0; j < 8; j++)
-        {
-          auto offset = abs(j - ~file);
-          if (offset == 0)
-            continue;
-          for (int coef = -1; coef <= 1; coef += 2)
-          {
-            auto end_rank = ~rank + coef * (j - ~file);
-            if (end_rank < 0 or 7 < end_rank)
-              continue;
-            plugin::Position end_pos(static_cast<plugin::File>(j),
-                static_cast<plugin::Rank>(end_rank));
-            push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-          }
-        }
-        break;
-      }
+  bitboard::square_t from = move.from_get();
+  bitboard::square_t to = move.to_get();
+  bool color = static_cast<bool>(side_to_move_);
+  bitboard_t from_bb = bitboard::square_bb(from);
+  bitboard_t to_bb = bitboard::square_bb(to);
+  if (move == CompactMove::none() or not (colors_[color] & from_bb)
+      or (colors_[color] & to_bb))
+    return false;
+  cell_t type = get_square(bitboard::position_of(from)) & 0b00000111;
+  bool capture = colors_[!color] & to_bb;
 
-    case plugin::PieceType::ROOK:
-      for (int i = 0; i < 8; i++)
-      {
-        if (i != ~file) {
-          plugin::Position end_pos(static_cast<plugin::File>(i), rank);
-          push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-        }
-        if (i != ~rank) {
-          plugin::Position end_pos(file, static_cast<plugin::Rank>(i));
-          push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-        }
-      }
-      break;
+  if (move.is_castling())
+  {
+    bool king_side = move.flags_get() == CompactMove::KING_CASTLING;
+    auto side = static_cast<plugin::Color>(color);
+    bitboard::square_t rook = bitboard::square_of(
+        initial_rook_position(side, king_side));
+    return (castling_rights_ & (1 << (2 * color + !king_side)))
+      and from == bitboard::square_of(initial_king_position(side))
+      and to == bitboard::square_of(castling_king_end_position(side,
+            king_side))
+      and (pieces_[color][2] & bitboard::square_bb(rook))
+      and not (attacks::between(from, rook) & occupancy_);
+  }
+  if (type != 5)
+    return (move.flags_get() == (capture ? CompactMove::CAPTURE
+          : CompactMove::QUIET))
+      and (attacks::piece_attacks(plugin::piecetype_array()[type],
+            side_to_move_, from, occupancy_) & to_bb);
 
-    case plugin::PieceType::BISHOP:
-      {
-        for (int j = 0; j < 8; j++)
-        {
-          auto offset = abs(j - ~file);
-          if (offset == 0)
-            continue;
-          for (int coef = -1; coef <= 1; coef += 2)
-          {
-            auto end_rank = ~rank + coef * (j - ~file);
-            if (end_rank < 0 or 7 < end_rank)
-              continue;
-            plugin::Position end_pos(static_cast<plugin::File>(j),
-                static_cast<plugin::Rank>(end_rank));
-            push_move(moves, QuietMove(color_piece, position, end_pos, piece_type));
-          }
-        }
-        break;
-      }
+  // Pawns
+  if (move.flags_get() == CompactMove::EN_PASSANT)
+    return to == en_passant_
+      and (attacks::pawn_attacks(side_to_move_, from) & to_bb);
+  bool last_rank = bitboard::rank_of(to) == (color ? 0 : 7);
+  if (move.is_promotion() != last_rank or move.is_capture() != capture)
+    return false;
+  if (capture)
+    return (move.is_promotion() or move.flags_get() == CompactMove::CAPTURE)
+      and (attacks::pawn_attacks(side_to_move_, from) & to_bb);
+  bitboard::square_t up = color ? -8 : 8;
+  if (move.flags_get() == CompactMove::DOUBLE_PUSH)
+    return to == from + 2 * up
+      and bitboard::rank_of(from) == (color ? 6 : 1)
+      and not ((bitboard::square_bb(from + up) | to_bb) & occupancy_);
+  return to == from + up and not (to_bb & occupancy_)
+    and (move.is_promotion() or move.flags_get() == CompactMove::QUIET);
+}
 
-    case plugin::PieceType::KNIGHT:
-      {
-        int x[2] = {1, 2};
-        int y[2] = {2, 1};
-
-        for (int j = 0; j < 2; ++j) {
-          auto x1 = x[j];
-          auto y1 = y[j];
-          for(int i = 0; i < 4; i++)
-          {
-            if (0 <= x1 + ~file and ~file + x1 < 8 and 0 <= ~rank + y1 and ~rank +y1 < 8)
-            {
-              plugin::Position pos_1(static_cast<plugin::File>(x1 +  ~file),
-                  static_cast<plugin::Rank>(y1 + ~rank));
-              push_move(moves, QuietMove(color_piece, position, pos_1, piece_type));
-            }
-
-            int temp;
-            temp = x1;
-            x1 = -y1;
-            y1 = temp;
-          }
-        }
-        break;
-      }
+// Whether the pseudo legal move leaves its own king safe
+bool ChessBoard::is_legal(CompactMove move) const
+{
+  bitboard::square_t from = move.from_get();
+  bitboard::square_t to = move.to_get();
+  bitboard_t from_bb = bitboard::square_bb(from);
+  bool color = colors_[1] & from_bb;
+  bitboard_t opponents = colors_[!color];
 
-    case plugin::PieceType::PAWN:
-      if (~position.rank_get() <= 0 or 7 <= ~position.rank_get())
-        break;
-      {
-        plugin::Position front(file, static_cast<plugin::Rank>(~rank + dir)); // Simple move
-        push_move(moves, QuietMove(color_piece, position, front, piece_type, false));
-      }
-      {
-        plugin::Position double_front(file, static_cast<plugin::Rank>(~rank + 2*dir)); // Double move
-        push_move(moves, QuietMove(color_piece, position, double_front, piece_type, false));
-      }
-      for (char i = -1; i <= 1; i += 2) { // Attack
-        if (~file + i < 0 or 7 < ~file + i)
-          continue;
-        plugin::Position diag_left(static_cast<plugin::File>(~file + i),
-            static_cast<plugin::Rank>(~rank + dir));
-        push_move(moves, QuietMove(color_piece, position, diag_left, piece_type, true));
+  if (move.is_castling())
+  {
+    // The king cannot castle out of, through or into check
+    return not ((attacks::between(from, to) | from_bb
+          | bitboard::square_bb(to)) & attacked_[!color]);
+  }
 
-      }
-      break;
+  bitboard_t captured = bitboard::square_bb(to);
+  if (move.flags_get() == CompactMove::EN_PASSANT)
+    captured = bitboard::square_bb(bitboard::square_of(
+          bitboard::file_of(to), bitboard::rank_of(from)));
+  bitboard_t occupancy = (occupancy_ ^ from_bb ^ captured)
+    | bitboard::square_bb(to);
+  bitboard::square_t king = (pieces_[color][0] & from_bb) ? to
+    : bitboard::lsb(pieces_[color][0]);
+  return not (attackers_to(king, occupancy) & opponents & ~captured);
+}
 
-    default:
-      throw "Impossible";
-      break;
+CompactMove ChessBoard::compact_get(const Move& move) const
+{
+  plugin::Color color = move.color_get();
+  if (move.move_type_get() != Move::Type::QUIET)
+  {
+    bool king_side = move.move_type_get() == Move::Type::KING_CASTLING;
+    return CompactMove(bitboard::square_of(initial_king_position(color)),
+        bitboard::square_of(castling_king_end_position(color, king_side)),
+        king_side ? CompactMove::KING_CASTLING : CompactMove::QUEEN_CASTLING);
   }
-  return moves;
+  const QuietMove& quiet_move = static_cast<const QuietMove&>(move);
+  bitboard::square_t from = bitboard::square_of(quiet_move.start_get());
+  bitboard::square_t to = bitboard::square_of(quiet_move.end_get());
+  uint16_t flags = CompactMove::QUIET;
+  if (occupancy_ & bitboard::square_bb(to))
+    flags = CompactMove::CAPTURE;
+  if (pieces_[static_cast<bool>(color)][5] & bitboard::square_bb(from))
+  {
+    if (flags == CompactMove::QUIET
+        and bitboard::file_of(from) != bitboard::file_of(to))
+      flags = CompactMove::EN_PASSANT;
+    else if (abs(to - from) == 16)
+      flags = CompactMove::DOUBLE_PUSH;
+  }
+  if (quiet_move.is_promotion())
+    flags |= CompactMove::PROMOTION | (4 - quiet_move.promotion_piecetype_get());
+  return CompactMove(from, to, flags);
 }
 
-void ChessBoard::push_move(std::vector<std::shared_ptr<Move>>& moves, QuietMove move) const
+std::shared_ptr<Move> ChessBoard::move_get(CompactMove move) const
 {
-  if (RuleChecker::is_move_valid(*this, move))
-    moves.push_back(std::make_shared<QuietMove>(move));
+  plugin::Position start = bitboard::position_of(move.from_get());
+  plugin::Color color = color_get(start);
+  if (move.flags_get() == CompactMove::KING_CASTLING)
+    return std::make_shared<Move>(Move::Type::KING_CASTLING, color);
+  if (move.flags_get() == CompactMove::QUEEN_CASTLING)
+    return std::make_shared<Move>(Move::Type::QUEEN_CASTLING, color);
+  return std::make_shared<QuietMove>(color, start,
+      bitboard::position_of(move.to_get()), piecetype_get(start).value(),
+      move.is_capture(), false,
+      move.is_promotion() ? move.promotion_piecetype_get() : -1);
 }
 
 plugin::Position ChessBoard::initial_king_position(plugin::Color c)
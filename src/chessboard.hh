@@ -1,6 +1,11 @@
 #pragma once
 
+#include "bitboard.hh"
+#include "compact-move.hh"
+#include "move-list.hh"
+#include "piece-square.hh"
 #include "quiet-move.hh"
+#include "zobrist.hh"
 #include "plugin/color.hh"
 #include "plugin/listener.hh"
 #include "plugin/piece-type.hh"
@@ -16,22 +21,119 @@ class ChessBoard
 public:
   using cell_t = uint8_t;
   using board_t = std::array<std::array<cell_t, 8>, 8>;
+  using bitboard_t = bitboard::bitboard_t;
+  using key_t = zobrist::key_t;
+  /* Up to 10 pieces of a type with promotions */
+  using piece_list_t = std::array<uint8_t, 10>;
+
+  /* State a move destroys, enough to take it back in place */
+  struct Undo
+  {
+    key_t key;
+    bitboard::square_t en_passant;
+    cell_t moved;
+    // Destination cell, or the rook for castling
+    cell_t captured;
+    unsigned char castling_rights;
+    unsigned char inactive_turn;
+  };
+
+  /* Told of each piece put on or taken off the board */
+  class PieceObserver
+  {
+  public:
+    virtual ~PieceObserver() = default;
+    /* Black if color, type indexed by auxiliary::PieceTypeToInt */
+    virtual void piece_changed(bool color, int type,
+                               bitboard::square_t square, bool add) = 0;
+  };
+
   ChessBoard(std::vector<plugin::Listener*>);
+  /* A copy has the position and its history, for repetitions, but not the
+   * listeners: they stay with their board. Neither has it the observer,
+   * which follows a single board. */
   ChessBoard(const ChessBoard&);
+  ChessBoard& operator=(const ChessBoard&);
   ChessBoard();
+  /* Position from a FEN record, throws std::invalid_argument if malformed */
+  explicit ChessBoard(const std::string& fen);
 
-  bool three_fold_repetition();
+  bool three_fold_repetition() const;
+  /* The position occurred times times before: a search takes a single
+   * repetition for a draw */
+  bool repetition(int times = 1) const;
 
   int update(std::shared_ptr<Move> move);
   void move_piece(plugin::Position start, plugin::Position end);
-  short apply_move(const Move& move);
-  void undo_move(const Move& move, short token);
+  void apply_move(const Move& move);
+  void apply_move(CompactMove move);
+  void apply_move(CompactMove move, Undo& undo);
+  void undo_move(CompactMove move, const Undo& undo);
+  /* Passes the turn, for null move pruning */
+  void apply_null_move(Undo& undo);
+  void undo_null_move(const Undo& undo);
+
+  /* Conversions between Move objects and packed moves, on the board the move
+   * is played from */
+  CompactMove compact_get(const Move& move) const;
+  std::shared_ptr<Move> move_get(CompactMove move) const;
 
   void set_square(plugin::Position position, cell_t value);
   cell_t get_square(plugin::Position position) const;
   inline cell_t get_opt(plugin::Position position, cell_t mask) const;
   
   const board_t& board_get() const;
+  key_t key_get() const {
+    return key_;
+  }
+  /* Key of the pawns alone */
+  key_t pawn_key_get() const {
+    return pawn_key_;
+  }
+  unsigned char inactive_turn_get() const {
+    return inactive_turn;
+  }
+  plugin::Color side_to_move_get() const {
+    return side_to_move_;
+  }
+  unsigned char castling_rights_get() const {
+    return castling_rights_;
+  }
+  /* Square a pawn can take en passant on, -1 if none */
+  bitboard::square_t en_passant_get() const {
+    return en_passant_;
+  }
+
+  /* Bitboard views, piece types are indexed by auxiliary::PieceTypeToInt */
+  bitboard_t pieces_bb(plugin::Color color, plugin::PieceType type) const;
+  bitboard_t pieces_bb(plugin::PieceType type) const;
+  bitboard_t color_bb(plugin::Color color) const;
+  bitboard_t occupancy_bb() const;
+
+  /* Squares of the pieces of a color and type, only the first
+   * piece_count_get are meaningful */
+  const piece_list_t& piece_list_get(plugin::Color color,
+                                     plugin::PieceType type) const;
+  int piece_count_get(plugin::Color color, plugin::PieceType type) const;
+
+  /* Running sums of piece_square values for the pieces of a color */
+  int material_get(plugin::Color color) const {
+    return material_[static_cast<bool>(color)];
+  }
+  int psqt_middle_get(plugin::Color color) const {
+    return psqt_middle_[static_cast<bool>(color)];
+  }
+  int psqt_end_get(plugin::Color color) const {
+    return psqt_end_[static_cast<bool>(color)];
+  }
+  /* Up to piece_square::phase_max, more after promotions */
+  int phase_get() const {
+    return phase_;
+  }
+
+  /* Tells observer of every piece now on the board as added, then of each
+   * change, none if nullptr. The observer has to outlive the board. */
+  void observer_set(PieceObserver* observer);
 
   inline std::experimental::optional<plugin::PieceType>
   piecetype_get(plugin::Position position) const; /* {
@@ -44,10 +146,26 @@ public:
   plugin::Color color_get(plugin::Position position) const;
   bool castleflag_get(plugin::Position position) const;
   bool is_attacked(plugin::Color color, plugin::Position) const;
+  bitboard_t attackers_to(bitboard::square_t square,
+                          bitboard_t occupancy) const;
+  /* Squares attacked by the pieces of color, and by how many of them */
+  bitboard_t attacked_bb(plugin::Color color) const;
+  int attack_count_get(plugin::Color color, bitboard::square_t square) const;
+
+  /* Captures also hold promotions and en passant, quiets hold castling */
+  enum class GenType
+  {
+    ALL,
+    CAPTURES,
+    QUIETS
+  };
 
   std::vector<std::shared_ptr<Move>> get_possible_actions(plugin::Color color) const;
-  std::vector<std::shared_ptr<Move>> get_possible_actions(plugin::Color playing_color, plugin::Position pos) const;
-  void push_move(std::vector<std::shared_ptr<Move>>& moves, QuietMove move) const;
+  void generate_moves(plugin::Color color, MoveList& moves,
+                      GenType type = GenType::ALL) const;
+  bool is_pseudo_legal(CompactMove move) const;
+  bool is_legal(CompactMove move) const;
+  bitboard_t pinned_bb(plugin::Color color) const;
 
   const std::shared_ptr<Move> last_move_get() const {
     return last_move_;
@@ -66,6 +184,18 @@ public:
   inline plugin::Position get_king_position(plugin::Color color) const;
 
 private:
+  void init_pieces();
+  void piece_toggle(bitboard::square_t square, cell_t value);
+  void sliders_update(bitboard::square_t square);
+  void attacks_add(bool color, bitboard_t squares);
+  void attacks_remove(bool color, bitboard_t squares);
+  void en_passant_set(bitboard::square_t square);
+
+  /* Castling rights, bit 0 and 1 for white king and queen side, 2 and 3 for
+   * black */
+  static constexpr unsigned char all_castling_rights = 0b1111;
+  static unsigned char castling_rights_kept(bitboard::square_t square);
+
   board_t board_ = {
     0x82, 0x84, 0x83, 0x81, 0x80, 0x83, 0x84, 0x82, 0x85, 0x85, 0x85,
     0x85, 0x85, 0x85, 0x85, 0x85, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87,
@@ -73,9 +203,31 @@ private:
     0x87, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87, 0x87,
     0x87, 0x87, 0x87, 0x87, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
     0x05, 0x02, 0x04, 0x03, 0x01, 0x00, 0x03, 0x04, 0x02};
+  std::array<std::array<bitboard_t, 6>, 2> pieces_;
+  std::array<bitboard_t, 2> colors_;
+  bitboard_t occupancy_;
+  std::array<std::array<piece_list_t, 6>, 2> piece_list_;
+  std::array<std::array<uint8_t, 6>, 2> piece_count_;
+  // Index of each occupied square in its piece list
+  std::array<uint8_t, 64> piece_index_;
+  // Squares attacked by the piece standing on each square
+  std::array<bitboard_t, 64> attacks_from_;
+  std::array<std::array<uint8_t, 64>, 2> attack_count_;
+  std::array<bitboard_t, 2> attacked_;
+  std::array<int, 2> material_;
+  std::array<int, 2> psqt_middle_;
+  std::array<int, 2> psqt_end_;
+  int phase_;
+  PieceObserver* observer_ = nullptr;
   std::shared_ptr<Move> last_move_;
   std::vector<plugin::Listener*> listeners_;
-  std::vector<board_t> previous_states_;
+  key_t key_;
+  key_t pawn_key_;
+  plugin::Color side_to_move_ = plugin::Color::WHITE;
+  unsigned char castling_rights_ = all_castling_rights;
+  // Square behind a pawn that just moved two squares, if it can be taken
+  bitboard::square_t en_passant_ = -1;
+  std::vector<key_t> previous_keys_;
   unsigned char inactive_turn = 0;
 };
 
@@ -114,16 +266,54 @@ ChessBoard::piecetype_get(plugin::Position position) const
 
 inline plugin::Position ChessBoard::get_king_position(plugin::Color color) const
 {
-  for (auto i = 0; i < 8; i++)
-  {
-    for (auto j = 0; j < 8; j++)
-    {
-      auto p = plugin::Position(static_cast<plugin::File>(j),
-          static_cast<plugin::Rank>(i));
-      if (piecetype_get(p) != std::experimental::nullopt and piecetype_get(p).value() ==  plugin::PieceType::KING and color_get(p) == color) {
-        return p;
-      }
-    }
-  }
-  throw std::invalid_argument("There is no king !");
+  bool c = static_cast<bool>(color);
+  if (piece_count_[c][0] == 0)
+    throw std::invalid_argument("There is no king !");
+  return bitboard::position_of(piece_list_[c][0][0]);
+}
+
+inline ChessBoard::bitboard_t ChessBoard::pieces_bb(plugin::Color color,
+    plugin::PieceType type) const
+{
+  return pieces_[static_cast<bool>(color)][auxiliary::PieceTypeToInt(type)];
+}
+
+inline ChessBoard::bitboard_t
+ChessBoard::pieces_bb(plugin::PieceType type) const
+{
+  return pieces_bb(plugin::Color::WHITE, type)
+    | pieces_bb(plugin::Color::BLACK, type);
+}
+
+inline ChessBoard::bitboard_t ChessBoard::color_bb(plugin::Color color) const
+{
+  return colors_[static_cast<bool>(color)];
+}
+
+inline ChessBoard::bitboard_t ChessBoard::occupancy_bb() const
+{
+  return occupancy_;
+}
+
+inline ChessBoard::bitboard_t ChessBoard::attacked_bb(plugin::Color color) const
+{
+  return attacked_[static_cast<bool>(color)];
+}
+
+inline int ChessBoard::attack_count_get(plugin::Color color,
+    bitboard::square_t square) const
+{
+  return attack_count_[static_cast<bool>(color)][square];
+}
+
+inline const ChessBoard::piece_list_t&
+ChessBoard::piece_list_get(plugin::Color color, plugin::PieceType type) const
+{
+  return piece_list_[static_cast<bool>(color)][auxiliary::PieceTypeToInt(type)];
+}
+
+inline int ChessBoard::piece_count_get(plugin::Color color,
+    plugin::PieceType type) const
+{
+  return piece_count_[static_cast<bool>(color)][auxiliary::PieceTypeToInt(type)];
 }
@@ -10,7 +10,9 @@ class Client
 public:
   using player_t = T;
   Client(const std::string& ip, const std::string& port, const std::string& pgn_path = "");
-  int start();
+  /* args are given to the player constructor after its color */
+  template <typename... Args>
+  int start(Args&&... args);
 
 private:
   network_api::ClientNetworkAPI client_;
@@ -18,13 +18,15 @@ Client<T>::Client(const std::string& ip, const std::string& port, const std::str
 }
 
 template <typename T>
-int Client<T>::start()
+template <typename... Args>
+int Client<T>::start(Args&&... args)
 {
   // connection confirmation from server?
 
   plugin::Color color =
     static_cast<plugin::Color>(client_.acknowledge("nicolas.roger"));
-  player_t player(color);
+  player_t player(color, std::forward<Args>(args)...);
+  player.info_set([this](const std::string& line) { client_.send(line); });
   std::vector<std::shared_ptr<Move>> moves; 
   if (pgn_path_ != "") {
     std::cerr << "reading file : " << pgn_path_ << std::endl;
@@ -72,6 +74,7 @@ int Client<T>::start()
 
     std::string input = player.play_next_move(received_move);
     client_.send("bestmove " + input);
+    player.ponder();
     }
     catch (std::exception& e)
     {
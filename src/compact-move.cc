@@ -0,0 +1,19 @@
+#include "compact-move.hh"
+
+#include "plugin-auxiliary.hh"
+
+std::string CompactMove::to_an() const
+{
+  std::string result;
+  result += auxiliary::to_lan(bitboard::position_of(from_get()));
+  result += auxiliary::to_lan(bitboard::position_of(to_get()));
+  if (is_promotion())
+    result += static_cast<char>(
+        plugin::piecetype_array()[promotion_piecetype_get()]);
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& o, CompactMove m)
+{
+  return o << m.to_an();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "bitboard.hh"
+#include "plugin/piece-type.hh"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/*
+** Move packed in 16 bits.
+**
+**     Bits 15-12 -- Flags
+**     Bits 11-6  -- Destination square
+**     Bits 5-0   -- Start square
+**
+** The flags tell the kind of move. When the promotion bit is set, the two
+** low flag bits give the promoted piece (knight, bishop, rook, queen).
+** Castling moves are stored as the move of the king.
+*/
+class CompactMove
+{
+public:
+  enum Flag : uint16_t
+  {
+    QUIET = 0,
+    DOUBLE_PUSH = 1,
+    KING_CASTLING = 2,
+    QUEEN_CASTLING = 3,
+    CAPTURE = 4,
+    EN_PASSANT = 5,
+    PROMOTION = 8,
+    PROMOTION_CAPTURE = 12
+  };
+
+  CompactMove() = default;
+  CompactMove(bitboard::square_t from, bitboard::square_t to,
+              uint16_t flags = QUIET)
+    : data_(from | (to << 6) | (flags << 12))
+  {}
+
+  static CompactMove none() {
+    return CompactMove(0, 0);
+  }
+
+  bitboard::square_t from_get() const {
+    return data_ & 0x3F;
+  }
+  bitboard::square_t to_get() const {
+    return (data_ >> 6) & 0x3F;
+  }
+  uint16_t flags_get() const {
+    return data_ >> 12;
+  }
+  bool is_capture() const {
+    return flags_get() & CAPTURE;
+  }
+  bool is_promotion() const {
+    return flags_get() & PROMOTION;
+  }
+  bool is_castling() const {
+    return flags_get() == KING_CASTLING or flags_get() == QUEEN_CASTLING;
+  }
+  /* Index of the promoted piece type, as given by auxiliary::PieceTypeToInt */
+  char promotion_piecetype_get() const {
+    return 4 - (flags_get() & 0b11);
+  }
+  uint16_t data_get() const {
+    return data_;
+  }
+
+  bool operator==(CompactMove m) const {
+    return data_ == m.data_;
+  }
+  bool operator!=(CompactMove m) const {
+    return data_ != m.data_;
+  }
+
+  /* UCI notation, e.g. e2e4, e1g1 or e7e8Q */
+  std::string to_an() const;
+
+private:
+  uint16_t data_;
+};
+
+std::ostream& operator<<(std::ostream& o, CompactMove m);
@@ -89,7 +89,12 @@ int Engine::start()
       clients_[color]->send("go");
 
       try {
-      client_move = clients_[color]->receive().substr(9);
+      // Players may report on their search before giving their move
+      std::string line;
+      do
+        line = clients_[color]->receive();
+      while (line.compare(0, 5, "info ") == 0);
+      client_move = line.substr(9);
       }
       catch (std::runtime_error& e)
       {
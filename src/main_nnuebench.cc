@@ -0,0 +1,165 @@
+#include "boost/program_options.hpp"
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "chessboard.hh"
+#include "nnue.hh"
+#include "plugin-auxiliary.hh"
+namespace po = boost::program_options;
+
+namespace
+{
+  struct Result
+  {
+    double evaluations_per_second;
+    double updates_per_second;
+    /* Sum of the evaluations, the same for every kernel */
+    long checksum;
+  };
+
+  // Evaluates every position of the games as they are played, then with
+  // each move played and taken back in turn
+  Result bench(const nnue::Network& network,
+               const std::vector<std::vector<CompactMove>>& games, int rounds)
+  {
+    Result result = {0, 0, 0};
+    // Accumulators of each position and the side to move
+    std::vector<std::pair<nnue::Accumulator, bool>> positions;
+    for (const auto& game : games)
+    {
+      ChessBoard board;
+      nnue::BoardAccumulator accumulator;
+      accumulator.attach(board, network);
+      for (auto move : game)
+      {
+        positions.emplace_back(accumulator.get(),
+                               static_cast<bool>(board.side_to_move_get()));
+        board.apply_move(move);
+      }
+    }
+
+    double seconds = 0;
+    {
+      scoped_timer timer(seconds);
+      for (int round = 0; round < rounds; ++round)
+        for (const auto& position : positions)
+          result.checksum += network.evaluate(position.first,
+                                              position.second);
+    }
+    result.evaluations_per_second = rounds * positions.size() / seconds;
+
+    long checksum = 0;
+    std::vector<ChessBoard::Undo> undos;
+    {
+      scoped_timer timer(seconds);
+      for (int round = 0; round < rounds; ++round)
+        for (const auto& game : games)
+        {
+          ChessBoard board;
+          nnue::BoardAccumulator accumulator;
+          accumulator.attach(board, network);
+          undos.resize(game.size());
+          for (size_t i = 0; i < game.size(); ++i)
+          {
+            checksum += network.evaluate(accumulator.get(),
+                static_cast<bool>(board.side_to_move_get()));
+            board.apply_move(game[i], undos[i]);
+          }
+          for (size_t i = game.size(); i-- > 0;)
+            board.undo_move(game[i], undos[i]);
+        }
+    }
+    result.updates_per_second = rounds * positions.size() / seconds;
+    if (checksum != result.checksum)
+      result.checksum = -1;
+    return result;
+  }
+}
+
+/* Evaluations per second of the network with each kernel the processor
+ * supports, on the positions of random games */
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "show usage")
+    ("network,n", po::value<std::string>(),
+     "network file, random weights if none")
+    ("games,g", po::value<int>()->default_value(50), "random games played")
+    ("rounds,r", po::value<int>()->default_value(20),
+     "times each position is evaluated");
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 2;
+  }
+  if (vm.count("help"))
+  {
+    std::cout << desc << "\n";
+    return 0;
+  }
+
+  nnue::Network network;
+  if (not vm.count("network"))
+    network.randomize(1);
+  else if (not network.load(vm["network"].as<std::string>()))
+  {
+    std::cerr << "Cannot read the network " << vm["network"].as<std::string>()
+              << std::endl;
+    return 1;
+  }
+
+  std::mt19937 random(1);
+  std::vector<std::vector<CompactMove>> games(vm["games"].as<int>());
+  for (auto& game : games)
+  {
+    ChessBoard board;
+    for (int ply = 0; ply < 200; ++ply)
+    {
+      MoveList moves;
+      board.generate_moves(board.side_to_move_get(), moves);
+      if (not moves.size())
+        break;
+      game.push_back(moves[random() % moves.size()]);
+      board.apply_move(game.back());
+    }
+  }
+
+  long checksum = 0;
+  bool first = true;
+  for (auto kernel : {nnue::Kernel::SCALAR, nnue::Kernel::SSE,
+                      nnue::Kernel::AVX2})
+  {
+    if (not nnue::kernel_supported(kernel))
+    {
+      std::cout << nnue::kernel_name(kernel) << ": not supported" << std::endl;
+      continue;
+    }
+    network.kernel_set(kernel);
+    Result result = bench(network, games, vm["rounds"].as<int>());
+    std::cout << nnue::kernel_name(kernel) << ": "
+              << long(result.evaluations_per_second) << " evaluations/s, "
+              << long(result.updates_per_second)
+              << " with make/unmake" << std::endl;
+    if (first)
+      checksum = result.checksum;
+    first = false;
+    if (result.checksum != checksum or result.checksum == -1)
+    {
+      std::cerr << nnue::kernel_name(kernel)
+                << " evaluations differ from the other kernels or after"
+                << " make/unmake" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "boost/program_options.hpp"
+#include <iostream>
+
+#include "perft.hh"
+#include "plugin-auxiliary.hh"
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "show usage")
+    ("fen,f", po::value<std::string>()->default_value(
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"),
+     "position to count from")
+    ("depth,d", po::value<int>()->default_value(5), "depth in plies")
+    ("divide", "print the count under each root move")
+    ("threads,t", po::value<unsigned>()->default_value(1),
+     "threads sharing the root moves")
+    ("expect,e", po::value<uint64_t>(),
+     "expected count, exits with failure on mismatch");
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 2;
+  }
+  if (vm.count("help"))
+  {
+    std::cout << desc << "\n";
+    return 0;
+  }
+
+  std::string fen = vm["fen"].as<std::string>();
+  int depth = vm["depth"].as<int>();
+  unsigned threads = std::max(vm["threads"].as<unsigned>(), 1u);
+  try
+  {
+    ChessBoard board(fen);
+    uint64_t nodes = 0;
+    double time = 0;
+    {
+      scoped_timer timer(time);
+      if (depth <= 0 or (threads == 1 and not vm.count("divide")))
+        nodes = perft::perft(board, depth);
+      else
+        for (auto& root : perft::divide(board, depth, threads))
+        {
+          if (vm.count("divide"))
+            std::cout << root.first << ": " << root.second << std::endl;
+          nodes += root.second;
+        }
+    }
+    std::cout << "Nodes: " << nodes << std::endl
+              << "Time: " << time << "s" << std::endl
+              << "NPS: " << static_cast<uint64_t>(nodes / std::max(time, 1e-9))
+              << std::endl;
+    if (vm.count("expect") and vm["expect"].as<uint64_t>() != nodes)
+    {
+      std::cerr << "Expected " << vm["expect"].as<uint64_t>() << " nodes"
+                << std::endl;
+      return 1;
+    }
+  }
+  catch (const std::invalid_argument& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
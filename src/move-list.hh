@@ -0,0 +1,57 @@
+#pragma once
+
+#include "compact-move.hh"
+#include <array>
+#include <cstddef>
+
+/*
+** Fixed capacity list of moves, meant to live on the stack. No position
+** has more than 218 legal moves.
+*/
+class MoveList
+{
+public:
+  static constexpr size_t capacity = 256;
+
+  void push(CompactMove move) {
+    moves_[size_++] = move;
+  }
+  void clear() {
+    size_ = 0;
+  }
+  void resize(size_t size) {
+    size_ = size;
+  }
+  size_t size() const {
+    return size_;
+  }
+  bool contains(CompactMove move) const {
+    for (auto m : *this)
+      if (m == move)
+        return true;
+    return false;
+  }
+
+  CompactMove& operator[](size_t i) {
+    return moves_[i];
+  }
+  CompactMove operator[](size_t i) const {
+    return moves_[i];
+  }
+  CompactMove* begin() {
+    return moves_.data();
+  }
+  CompactMove* end() {
+    return moves_.data() + size_;
+  }
+  const CompactMove* begin() const {
+    return moves_.data();
+  }
+  const CompactMove* end() const {
+    return moves_.data() + size_;
+  }
+
+private:
+  std::array<CompactMove, capacity> moves_;
+  size_t size_ = 0;
+};
@@ -0,0 +1,370 @@
+#include "nnue.hh"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define NNUE_X86
+# include <immintrin.h>
+#endif
+
+namespace
+{
+  using namespace nnue;
+
+  constexpr char magic[4] = {'P', 'P', 'N', 'N'};
+  constexpr int32_t version = 1;
+
+  template <typename T>
+  bool read_array(std::istream& in, std::vector<T>& values, size_t count)
+  {
+    values.resize(count);
+    for (auto& value : values)
+    {
+      uint64_t bits = 0;
+      for (size_t i = 0; i < sizeof (T); ++i)
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(in.get()))
+          << 8 * i;
+      value = static_cast<T>(bits);
+    }
+    return static_cast<bool>(in);
+  }
+
+  template <typename T>
+  void write_array(std::ostream& out, const std::vector<T>& values)
+  {
+    for (auto value : values)
+      for (size_t i = 0; i < sizeof (T); ++i)
+        out.put(static_cast<char>(static_cast<uint64_t>(value) >> 8 * i));
+  }
+
+  // Index of a feature seen from side
+  int feature_get(bool side, bool color, int type, bitboard::square_t square)
+  {
+    return ((color != side) * 6 + type) * 64 + (side ? square ^ 56 : square);
+  }
+
+  /* Accumulator update, clipping of an accumulator to 8 bits and hidden
+   * layer sums, one version per kernel */
+
+  void update_scalar(int16_t* values, const int16_t* weights, bool add)
+  {
+    for (int i = 0; i < accumulator_size; ++i)
+      values[i] += add ? weights[i] : -weights[i];
+  }
+
+  void clip_scalar(const int16_t* values, uint8_t* output)
+  {
+    for (int i = 0; i < accumulator_size; ++i)
+      output[i] = std::min<int16_t>(std::max<int16_t>(values[i], 0), 127);
+  }
+
+  void hidden_scalar(const uint8_t* input, const int8_t* weights,
+                     const int32_t* bias, int32_t* output)
+  {
+    for (int n = 0; n < hidden_size; ++n)
+    {
+      int32_t sum = bias[n];
+      const int8_t* row = weights + n * 2 * accumulator_size;
+      for (int i = 0; i < 2 * accumulator_size; ++i)
+        sum += input[i] * row[i];
+      output[n] = sum;
+    }
+  }
+
+#ifdef NNUE_X86
+  __attribute__((target("ssse3")))
+  void update_sse(int16_t* values, const int16_t* weights, bool add)
+  {
+    for (int i = 0; i < accumulator_size; i += 8)
+    {
+      auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+      auto w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+      v = add ? _mm_add_epi16(v, w) : _mm_sub_epi16(v, w);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), v);
+    }
+  }
+
+  // packus saturates the negative values to 0
+  __attribute__((target("ssse3")))
+  void clip_sse(const int16_t* values, uint8_t* output)
+  {
+    const auto max = _mm_set1_epi16(127);
+    for (int i = 0; i < accumulator_size; i += 16)
+    {
+      auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+      auto b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 8));
+      auto bytes = _mm_packus_epi16(_mm_min_epi16(a, max),
+                                    _mm_min_epi16(b, max));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), bytes);
+    }
+  }
+
+  // maddubs multiplies the unsigned inputs with the signed weights and adds
+  // pairs, which cannot saturate with inputs up to 127
+  __attribute__((target("ssse3")))
+  void hidden_sse(const uint8_t* input, const int8_t* weights,
+                  const int32_t* bias, int32_t* output)
+  {
+    const auto ones = _mm_set1_epi16(1);
+    for (int n = 0; n < hidden_size; ++n)
+    {
+      const int8_t* row = weights + n * 2 * accumulator_size;
+      auto sum = _mm_setzero_si128();
+      for (int i = 0; i < 2 * accumulator_size; i += 16)
+      {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        auto w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        sum = _mm_add_epi32(sum,
+                            _mm_madd_epi16(_mm_maddubs_epi16(x, w), ones));
+      }
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+      output[n] = bias[n] + _mm_cvtsi128_si32(sum);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void update_avx2(int16_t* values, const int16_t* weights, bool add)
+  {
+    for (int i = 0; i < accumulator_size; i += 16)
+    {
+      auto v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+      auto w =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+      v = add ? _mm256_add_epi16(v, w) : _mm256_sub_epi16(v, w);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), v);
+    }
+  }
+
+  // packus works within 128 bits lanes, the permutation puts the quarters
+  // back in order
+  __attribute__((target("avx2")))
+  void clip_avx2(const int16_t* values, uint8_t* output)
+  {
+    const auto max = _mm256_set1_epi16(127);
+    for (int i = 0; i < accumulator_size; i += 32)
+    {
+      auto a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+      auto b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 16));
+      auto bytes = _mm256_packus_epi16(_mm256_min_epi16(a, max),
+                                       _mm256_min_epi16(b, max));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i),
+                          _mm256_permute4x64_epi64(bytes, 0xD8));
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void hidden_avx2(const uint8_t* input, const int8_t* weights,
+                   const int32_t* bias, int32_t* output)
+  {
+    const auto ones = _mm256_set1_epi16(1);
+    for (int n = 0; n < hidden_size; ++n)
+    {
+      const int8_t* row = weights + n * 2 * accumulator_size;
+      auto sum = _mm256_setzero_si256();
+      for (int i = 0; i < 2 * accumulator_size; i += 32)
+      {
+        auto x =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        auto w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        sum = _mm256_add_epi32(
+            sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+      }
+      auto half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                _mm256_extracti128_si256(sum, 1));
+      half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+      half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+      output[n] = bias[n] + _mm_cvtsi128_si32(half);
+    }
+  }
+#endif
+}
+
+namespace nnue
+{
+  bool kernel_supported(Kernel kernel)
+  {
+    switch (kernel)
+    {
+#ifdef NNUE_X86
+      case Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+      case Kernel::SSE:
+        return __builtin_cpu_supports("ssse3");
+#endif
+      case Kernel::SCALAR:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  Kernel kernel_best()
+  {
+    for (auto kernel : {Kernel::AVX2, Kernel::SSE})
+      if (kernel_supported(kernel))
+        return kernel;
+    return Kernel::SCALAR;
+  }
+
+  const char* kernel_name(Kernel kernel)
+  {
+    switch (kernel)
+    {
+      case Kernel::AVX2:
+        return "avx2";
+      case Kernel::SSE:
+        return "sse";
+      default:
+        return "scalar";
+    }
+  }
+
+  // Magic "PPNN", then version, input, accumulator and hidden sizes on 32
+  // bits, then the weights layer by layer, biases first, all little endian
+  bool Network::load(const std::string& path)
+  {
+    std::ifstream in(path, std::ios::binary);
+    char header[4];
+    std::vector<int32_t> sizes;
+    if (not in.read(header, 4) or not std::equal(header, header + 4, magic)
+        or not read_array(in, sizes, 4) or sizes[0] != version
+        or sizes[1] != inputs or sizes[2] != accumulator_size
+        or sizes[3] != hidden_size)
+      return false;
+    std::vector<int32_t> output_bias;
+    if (not read_array(in, ft_bias_, accumulator_size)
+        or not read_array(in, ft_weights_, inputs * accumulator_size)
+        or not read_array(in, hidden_bias_, hidden_size)
+        or not read_array(in, hidden_weights_,
+                          hidden_size * 2 * accumulator_size)
+        or not read_array(in, output_bias, 1)
+        or not read_array(in, output_weights_, hidden_size))
+    {
+      ft_weights_.clear();
+      return false;
+    }
+    output_bias_ = output_bias[0];
+    return true;
+  }
+
+  void Network::save(const std::string& path) const
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (not out)
+      throw std::runtime_error("Cannot write the network " + path);
+    out.write(magic, 4);
+    write_array(out, std::vector<int32_t>{version, inputs, accumulator_size,
+                                           hidden_size});
+    write_array(out, ft_bias_);
+    write_array(out, ft_weights_);
+    write_array(out, hidden_bias_);
+    write_array(out, hidden_weights_);
+    write_array(out, std::vector<int32_t>{output_bias_});
+    write_array(out, output_weights_);
+    if (not out)
+      throw std::runtime_error("Cannot write the network " + path);
+  }
+
+  // Small enough for the accumulators to stay in 16 bits with every piece on
+  // the board
+  void Network::randomize(uint32_t seed)
+  {
+    std::mt19937 random(seed);
+    auto fill = [&random](auto& values, size_t count, int low, int high) {
+      std::uniform_int_distribution<int> distribution(low, high);
+      values.resize(count);
+      for (auto& value : values)
+        value = distribution(random);
+    };
+    fill(ft_bias_, accumulator_size, -64, 64);
+    fill(ft_weights_, inputs * accumulator_size, -32, 32);
+    fill(hidden_bias_, hidden_size, -1024, 1024);
+    fill(hidden_weights_, hidden_size * 2 * accumulator_size, -64, 64);
+    output_bias_ = std::uniform_int_distribution<int>(-256, 256)(random);
+    fill(output_weights_, hidden_size, -127, 127);
+  }
+
+  void Network::reset(Accumulator& accumulator) const
+  {
+    for (auto& values : accumulator)
+      std::copy(ft_bias_.begin(), ft_bias_.end(), values.begin());
+  }
+
+  void Network::update(Accumulator& accumulator, bool color, int type,
+                       bitboard::square_t square, bool add) const
+  {
+    for (bool side : {false, true})
+    {
+      int16_t* values = accumulator[side].data();
+      const int16_t* weights = ft_weights_.data()
+        + feature_get(side, color, type, square) * accumulator_size;
+      switch (kernel_)
+      {
+#ifdef NNUE_X86
+        case Kernel::AVX2:
+          update_avx2(values, weights, add);
+          break;
+        case Kernel::SSE:
+          update_sse(values, weights, add);
+          break;
+#endif
+        default:
+          update_scalar(values, weights, add);
+      }
+    }
+  }
+
+  int Network::evaluate(const Accumulator& accumulator, bool side) const
+  {
+    std::array<uint8_t, 2 * accumulator_size> input;
+    std::array<int32_t, hidden_size> hidden;
+    switch (kernel_)
+    {
+#ifdef NNUE_X86
+      case Kernel::AVX2:
+        clip_avx2(accumulator[side].data(), input.data());
+        clip_avx2(accumulator[!side].data(), input.data() + accumulator_size);
+        hidden_avx2(input.data(), hidden_weights_.data(), hidden_bias_.data(),
+                    hidden.data());
+        break;
+      case Kernel::SSE:
+        clip_sse(accumulator[side].data(), input.data());
+        clip_sse(accumulator[!side].data(), input.data() + accumulator_size);
+        hidden_sse(input.data(), hidden_weights_.data(), hidden_bias_.data(),
+                   hidden.data());
+        break;
+#endif
+      default:
+        clip_scalar(accumulator[side].data(), input.data());
+        clip_scalar(accumulator[!side].data(),
+                    input.data() + accumulator_size);
+        hidden_scalar(input.data(), hidden_weights_.data(),
+                      hidden_bias_.data(), hidden.data());
+    }
+    int32_t output = output_bias_;
+    for (int n = 0; n < hidden_size; ++n)
+      output += std::min(std::max(hidden[n] >> weight_shift, 0), 127)
+        * output_weights_[n];
+    return output / output_scale;
+  }
+
+  void BoardAccumulator::attach(ChessBoard& board, const Network& network)
+  {
+    network_ = &network;
+    network_->reset(accumulator_);
+    board.observer_set(this);
+  }
+
+  void BoardAccumulator::piece_changed(bool color, int type,
+                                       bitboard::square_t square, bool add)
+  {
+    network_->update(accumulator_, color, type, square, add);
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "bitboard.hh"
+#include "chessboard.hh"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+** Efficiently updatable neural network evaluation.
+**
+** The input is one feature per (color, piece, square) seen from each side,
+** the side's own pieces first and the board flipped for black. The first
+** layer sums the weights of the features present into an accumulator per
+** side, which a BoardAccumulator updates as pieces come and go. The two
+** accumulators, the side to move's first, are clipped to [0, 127] and go
+** through a hidden layer of hidden_size clipped neurons to the output.
+**
+** Weights are quantized: the accumulators and their weights are 16 bits,
+** the hidden layers 8 bits with their sums shifted right by weight_shift,
+** and the output is in centipawns times output_scale.
+*/
+namespace nnue
+{
+  constexpr int inputs = 2 * 6 * 64;
+  constexpr int accumulator_size = 256;
+  constexpr int hidden_size = 32;
+  constexpr int weight_shift = 6;
+  constexpr int output_scale = 16;
+
+  /* One per side, indexed by color */
+  using Accumulator = std::array<std::array<int16_t, accumulator_size>, 2>;
+
+  /* Implementations of the layers, all give the same results */
+  enum class Kernel
+  {
+    SCALAR,
+    SSE,
+    AVX2
+  };
+
+  bool kernel_supported(Kernel kernel);
+  /* Fastest kernel the processor supports */
+  Kernel kernel_best();
+  const char* kernel_name(Kernel kernel);
+
+  class Network
+  {
+  public:
+    /* Reads a network written by save, false if path cannot be read or does
+     * not hold one */
+    bool load(const std::string& path);
+    /* Throws std::runtime_error on failure */
+    void save(const std::string& path) const;
+    /* Random weights of a plausible range, for benchmarks */
+    void randomize(uint32_t seed);
+    bool is_loaded() const {
+      return not ft_weights_.empty();
+    }
+
+    Kernel kernel_get() const {
+      return kernel_;
+    }
+    void kernel_set(Kernel kernel) {
+      kernel_ = kernel;
+    }
+
+    /* Accumulators of an empty board */
+    void reset(Accumulator& accumulator) const;
+    /* Adds or removes a piece, black if color, of type indexed by
+     * auxiliary::PieceTypeToInt */
+    void update(Accumulator& accumulator, bool color, int type,
+                bitboard::square_t square, bool add) const;
+    /* Centipawns for side, black if side */
+    int evaluate(const Accumulator& accumulator, bool side) const;
+
+  private:
+    std::vector<int16_t> ft_bias_;
+    /* accumulator_size weights per input */
+    std::vector<int16_t> ft_weights_;
+    std::vector<int32_t> hidden_bias_;
+    /* 2 * accumulator_size weights per hidden neuron */
+    std::vector<int8_t> hidden_weights_;
+    int32_t output_bias_ = 0;
+    std::vector<int8_t> output_weights_;
+    Kernel kernel_ = kernel_best();
+  };
+
+  /* Accumulators of a network kept up to date with the pieces of a board */
+  class BoardAccumulator : public ChessBoard::PieceObserver
+  {
+  public:
+    /* Follows board from its current pieces on, the network and the
+     * accumulator have to outlive the board */
+    void attach(ChessBoard& board, const Network& network);
+    const Accumulator& get() const {
+      return accumulator_;
+    }
+    void piece_changed(bool color, int type, bitboard::square_t square,
+                       bool add) override;
+
+  private:
+    const Network* network_ = nullptr;
+    Accumulator accumulator_;
+  };
+}
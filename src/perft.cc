@@ -0,0 +1,59 @@
+#include "perft.hh"
+#include <atomic>
+#include <thread>
+
+namespace perft
+{
+  uint64_t perft(ChessBoard& board, int depth)
+  {
+    if (depth == 0)
+      return 1;
+    MoveList moves;
+    board.generate_moves(board.side_to_move_get(), moves);
+    // Bulk counting, the last ply does not need to be played
+    if (depth == 1)
+      return moves.size();
+    uint64_t nodes = 0;
+    ChessBoard::Undo undo;
+    for (auto move : moves)
+    {
+      board.apply_move(move, undo);
+      nodes += perft(board, depth - 1);
+      board.undo_move(move, undo);
+    }
+    return nodes;
+  }
+
+  std::vector<std::pair<CompactMove, uint64_t>>
+  divide(const ChessBoard& board, int depth, unsigned threads)
+  {
+    MoveList moves;
+    board.generate_moves(board.side_to_move_get(), moves);
+    std::vector<std::pair<CompactMove, uint64_t>> result;
+    for (auto move : moves)
+      result.emplace_back(move, 0);
+    if (depth <= 0)
+      return result;
+
+    // Every worker takes the next root move left, on its own board
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+      ChessBoard copy(board);
+      ChessBoard::Undo undo;
+      for (size_t i = next++; i < result.size(); i = next++)
+      {
+        copy.apply_move(result[i].first, undo);
+        result[i].second = perft(copy, depth - 1);
+        copy.undo_move(result[i].first, undo);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+      workers.emplace_back(worker);
+    worker();
+    for (auto& t : workers)
+      t.join();
+    return result;
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "chessboard.hh"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+** Move path enumeration, counting the leaves of the legal move tree.
+**
+** The counts are compared against known values to check the move generator
+** and timed to measure it.
+*/
+namespace perft
+{
+  /* Leaves at depth from board, with the side to move of board playing */
+  uint64_t perft(ChessBoard& board, int depth);
+
+  /* Leaves under each root move, root moves are shared between threads */
+  std::vector<std::pair<CompactMove, uint64_t>>
+  divide(const ChessBoard& board, int depth, unsigned threads = 1);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "bitboard.hh"
+#include <array>
+
+/*
+** Material values and piece-square tables of the evaluation, kept summed on
+** the board as pieces come and go.
+**
+** Piece types are indexed by auxiliary::PieceTypeToInt. Tables are seen
+** from white, rank 8 first as the board is printed, and are mirrored for
+** black. Only the king has different middlegame and endgame tables, the
+** game phase blends the two.
+*/
+namespace piece_square
+{
+  using table_t = std::array<std::array<int, 8>, 8>;
+
+  constexpr std::array<int, 6> material = {{0, 900, 500, 300, 300, 100}};
+
+  /* Phase of the game, from phase_max with every piece on the board to 0
+   * with only kings and pawns left */
+  constexpr std::array<int, 6> phase_weight = {{0, 4, 2, 1, 1, 0}};
+  constexpr int phase_max = 24;
+
+  constexpr table_t pawn = {{
+    {{0, 0, 0, 0, 0, 0, 0, 0}},
+    {{50, 50, 50, 50, 50, 50, 50, 50}},
+    {{10, 10, 20, 30, 30, 20, 10, 10}},
+    {{5, 5, 10, 25, 25, 10, 5, 5}},
+    {{0, 0, 0, 20, 20, 0, 0, 0}},
+    {{5, -5, -10, 0, 0, -10, -5, 5}},
+    {{5, 10, 10, -20, -20, 10, 10, 5}},
+    {{0, 0, 0, 0, 0, 0, 0, 0}}
+  }};
+
+  constexpr table_t knight = {{
+    {{-50, -40, -30, -30, -30, -30, -40, -50}},
+    {{-40, -20, 0, 0, 0, 0, -20, -40}},
+    {{-30, 0, 10, 15, 15, 10, 0, -30}},
+    {{-30, 5, 15, 20, 20, 15, 5, -30}},
+    {{-30, 0, 15, 20, 20, 15, 0, -30}},
+    {{-30, 5, 10, 15, 15, 10, 5, -30}},
+    {{-40, -20, 0, 5, 5, 0, -20, -40}},
+    {{-50, -40, -30, -30, -30, -30, -40, -50}}
+  }};
+
+  constexpr table_t bishop = {{
+    {{-20, -10, -10, -10, -10, -10, -10, -20}},
+    {{-10, 0, 0, 0, 0, 0, 0, -10}},
+    {{-10, 0, 5, 10, 10, 5, 0, -10}},
+    {{-10, 5, 5, 10, 10, 5, 5, -10}},
+    {{-10, 0, 10, 10, 10, 10, 0, -10}},
+    {{-10, 10, 10, 10, 10, 10, 10, -10}},
+    {{-10, 5, 0, 0, 0, 0, 5, -10}},
+    {{-20, -10, -10, -10, -10, -10, -10, -20}}
+  }};
+
+  constexpr table_t rook = {{
+    {{0, 0, 0, 0, 0, 0, 0, 0}},
+    {{5, 10, 10, 10, 10, 10, 10, 5}},
+    {{-5, 0, 0, 0, 0, 0, 0, -5}},
+    {{-5, 0, 0, 0, 0, 0, 0, -5}},
+    {{-5, 0, 0, 0, 0, 0, 0, -5}},
+    {{-5, 0, 0, 0, 0, 0, 0, -5}},
+    {{-5, 0, 0, 0, 0, 0, 0, -5}},
+    {{0, 0, 0, 5, 5, 0, 0, 0}}
+  }};
+
+  constexpr table_t queen = {{
+    {{-20, -10, -10, -5, -5, -10, -10, -20}},
+    {{-10, 0, 0, 0, 0, 0, 0, -10}},
+    {{-10, 0, 5, 5, 5, 5, 0, -10}},
+    {{-5, 0, 5, 5, 5, 5, 0, -5}},
+    {{0, 0, 5, 5, 5, 5, 0, -10}},
+    {{-10, 5, 5, 5, 5, 5, 0, -10}},
+    {{-10, 0, 5, 0, 0, 0, 0, -10}},
+    {{-20, -10, -10, -5, -5, -10, -10, -20}}
+  }};
+
+  constexpr table_t king_middle = {{
+    {{-30, -40, -40, -50, -50, -40, -40, -30}},
+    {{-30, -40, -40, -50, -50, -40, -40, -30}},
+    {{-30, -40, -40, -50, -50, -40, -40, -30}},
+    {{-30, -40, -40, -50, -50, -40, -40, -30}},
+    {{-20, -30, -30, -40, -40, -30, -30, -20}},
+    {{-10, -20, -20, -20, -20, -20, -20, -10}},
+    {{20, 20, 0, 0, 0, 0, 20, 20}},
+    {{20, 30, 10, 0, 0, 10, 30, 20}}
+  }};
+
+  constexpr table_t king_end = {{
+    {{-50, -40, -30, -20, -20, -30, -40, -50}},
+    {{-30, -20, -10, 0, 0, -10, -20, -30}},
+    {{-30, -10, 20, 30, 30, 20, -10, -30}},
+    {{-30, -10, 30, 40, 40, 30, -10, -30}},
+    {{-30, -10, 30, 40, 40, 30, -10, -30}},
+    {{-30, -10, 20, 30, 30, 20, -10, -30}},
+    {{-30, -30, 0, 0, 0, 0, -30, -30}},
+    {{-50, -30, -30, -30, -30, -30, -30, -50}}
+  }};
+
+  constexpr std::array<table_t, 6> middle = {{
+    king_middle, queen, rook, bishop, knight, pawn
+  }};
+  constexpr std::array<table_t, 6> end = {{
+    king_end, queen, rook, bishop, knight, pawn
+  }};
+
+  /* Bonus of a piece of type on square in tables, black if color */
+  constexpr int value_get(const std::array<table_t, 6>& tables, bool color,
+                          int type, bitboard::square_t square)
+  {
+    return tables[type][color ? bitboard::rank_of(square)
+                              : 7 - bitboard::rank_of(square)]
+                       [bitboard::file_of(square)];
+  }
+}
@@ -3,3 +3,8 @@
 Player::Player(plugin::Color color)
   : color_(color)
 {}
+
+void Player::info_set(info_t info)
+{
+  info_ = info;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <memory>
@@ -12,6 +13,13 @@ class Player
     Player(plugin::Color color);
     virtual std::string play_next_move(const std::string& received_move) = 0;
     virtual void set_scripted_moves( std::vector<std::shared_ptr<Move>> moves) = 0;
+    /* Called once the move is sent, the player may think until the next
+     * play_next_move */
+    virtual void ponder() {}
+    /* Where to send UCI info lines while thinking */
+    using info_t = std::function<void(const std::string&)>;
+    void info_set(info_t info);
   protected:
     const plugin::Color color_;
+    info_t info_;
 };
@@ -27,13 +27,7 @@ bool RuleChecker::is_move_valid(const ChessBoard& board, Move& move)
       return true;
   }
   //std::cerr << "checking that " << move << " doesn't cause a check to " << move.color_get() << std::endl;
-  auto tmp = ChessBoard(board);
-  tmp.apply_move(move);
-  plugin::Position king_pos = tmp.get_king_position(move.color_get());
-  //std::cerr << "king_pos is " << king_pos << std::endl;
-  if (isCheck(tmp, king_pos))
-    return false;
-  return true;
+  return board.is_legal(board.compact_get(move));
 }
 
 bool RuleChecker::isMoveAuthorized(const ChessBoard& board, Move& move)
@@ -209,116 +203,17 @@ bool RuleChecker::isMoveLegal(const ChessBoard& board, Move& move)
 
 bool RuleChecker::no_possible_move(const ChessBoard& board, plugin::Color color)
 {
-  for (int i = 0; i < 8; ++i)
-  {
-    for (int j = 0; j < 8; ++j)
-    {
-      plugin::Position start_pos(static_cast<plugin::File>(i),
-          static_cast<plugin::Rank>(j));
-      if (board.piecetype_get(start_pos) != std::experimental::nullopt and
-          board.color_get(start_pos) == color)
-      {
-        for (int x = 0; x < 8; ++x)
-        {
-          for (int y = 0; y < 8; ++y)
-          {
-            if (i == x and j == y)
-              continue;
-            plugin::Position end_pos(static_cast<plugin::File>(x),
-                static_cast<plugin::Rank>(y));
-            QuietMove quiet_move(color, start_pos, end_pos,
-                board.piecetype_get(start_pos).value());
-            if (RuleChecker::is_move_valid(board, quiet_move)) {
-              return false;
-            }
-          }
-        }
-      }
-    }
-  }
-  Move king_castling(Move::Type::KING_CASTLING, color);
-  if (RuleChecker::is_move_valid(board, king_castling))
-    return false;
-  Move queen_castling(Move::Type::QUEEN_CASTLING, color);
-  if (RuleChecker::is_move_valid(board, queen_castling))
-    return false;
-  return true;
+  return possible_moves(board, color).size() == 0;
 }
 
-std::vector<std::shared_ptr<Move>> RuleChecker::possible_moves(const ChessBoard& board, plugin::Color color)
+MoveList RuleChecker::possible_moves(const ChessBoard& board, plugin::Color color)
 {
-  std::vector<std::shared_ptr<Move>> moves;
-  for (int i = 0; i < 8; ++i)
-  {
-    for (int j = 0; j < 8; ++j)
-    {
-      plugin::Position start_pos(static_cast<plugin::File>(i),
-          static_cast<plugin::Rank>(j));
-      if (board.piecetype_get(start_pos) != std::experimental::nullopt and
-          board.color_get(start_pos) == color)
-      {
-        for (char x = 0; x < 8; ++x)
-        {
-          for (char y = 0; y < 8; ++y)
-          {
-            if (~start_pos.file_get() == x and ~start_pos.rank_get() == y)
-              continue;
-            plugin::Position end_pos(static_cast<plugin::File>(x),
-                static_cast<plugin::Rank>(y));
-            for (int attack = 0; attack <= 0; ++attack)
-            {
-              if (board.piecetype_get(start_pos) == plugin::PieceType::PAWN)
-              {
-                QuietMove quiet_move(color, start_pos, end_pos,
-                    board.piecetype_get(start_pos).value(),
-                    attack, false, 1);
-                if (RuleChecker::is_move_valid(board, quiet_move))
-                  moves.push_back(std::make_shared<QuietMove>(quiet_move));
-              }
-              QuietMove quiet_move(color, start_pos, end_pos,
-                  board.piecetype_get(start_pos).value(),
-                  attack, false);
-              if (RuleChecker::is_move_valid(board, quiet_move))
-                moves.push_back(std::make_shared<QuietMove>(quiet_move));
-            }
-          }
-        }
-      }
-    }
-  }
-  Move king_castling(Move::Type::KING_CASTLING, color);
-  if (RuleChecker::is_move_valid(board, king_castling))
-    moves.push_back(std::make_shared<Move>(Move::Type::KING_CASTLING, color));
-  Move queen_castling(Move::Type::QUEEN_CASTLING, color);
-  if (RuleChecker::is_move_valid(board, queen_castling))
-    moves.push_back(std::make_shared<Move>(Move::Type::QUEEN_CASTLING, color));
+  MoveList moves;
+  board.generate_moves(color, moves);
   return moves;
-
 }
 
 bool RuleChecker::isCheck(const ChessBoard& board, plugin::Position king_pos)
 {
   return board.is_attacked(board.color_get(king_pos), king_pos);
 }
-
-bool RuleChecker::three_fold_repetition(const std::vector<ChessBoard::board_t> permanent, const std::vector<ChessBoard*> temp)
-{
-  int counter = 0;
-  const ChessBoard::board_t& last_board = temp.back()->board_get();
-  for (auto it = temp.rbegin() + 1; it != temp.rend(); ++it) {
-    if ((*it)->board_get() == last_board) {
-      if (counter == 1)
-        return true;
-      ++counter;
-    }
-  }
-  for (auto it = permanent.rbegin(); it != permanent.rend(); ++it) {
-    if (*it == last_board) {
-      if (counter == 1)
-        return true;
-      ++counter;
-    }
-  }
-  return false;
-}
-
@@ -17,7 +17,6 @@ private:
 
 public:
   static bool no_possible_move(const ChessBoard& board, plugin::Color color);
-  static std::vector<std::shared_ptr<Move>> possible_moves(const ChessBoard& board, plugin::Color color);
+  static MoveList possible_moves(const ChessBoard& board, plugin::Color color);
   static bool isCheck(const ChessBoard& board, plugin::Position position);
-  static bool three_fold_repetition(const std::vector<ChessBoard::board_t> permanent, const std::vector<ChessBoard*> temp);
 };
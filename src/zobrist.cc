@@ -0,0 +1,35 @@
+#include "zobrist.hh"
+
+#include <random>
+
+namespace zobrist
+{
+  key_t pieces[2][6][64];
+  key_t castling[16];
+  key_t en_passant[8];
+  key_t side;
+
+  namespace
+  {
+    struct Initializer
+    {
+      Initializer()
+      {
+        // Fixed seed, keys must not change between runs
+        std::mt19937_64 random(1070372);
+        for (auto& color_pieces : pieces)
+          for (auto& piece : color_pieces)
+            for (auto& key : piece)
+              key = random();
+        castling[0] = 0;
+        for (int rights = 1; rights < 16; ++rights)
+          castling[rights] = random();
+        for (auto& key : en_passant)
+          key = random();
+        side = random();
+      }
+    };
+
+    Initializer initializer;
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "bitboard.hh"
+#include <cstdint>
+
+/*
+** Zobrist keys.
+**
+** A position key is the xor of one random number per (color, piece, square)
+** on the board, one per castling rights combination, one per en passant
+** file and one when black is to move. Moves update it incrementally.
+*/
+namespace zobrist
+{
+  using key_t = uint64_t;
+
+  extern key_t pieces[2][6][64];
+  extern key_t castling[16];
+  extern key_t en_passant[8];
+  extern key_t side;
+}
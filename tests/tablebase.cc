@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "AI/tablebase-generator.hh"
+#include "rule-checker.hh"
+
+/* Generates the tables a material needs and checks known results, the
+ * probe of every position of the 3-piece tables against the stored values,
+ * and en passant in KPvKP. Run with 3 or en-passant. */
+namespace
+{
+  using square_t = Tablebase::square_t;
+  using squares_t = std::array<square_t, Tablebase::max_pieces>;
+
+  int errors = 0;
+
+  void fail(const std::string& message)
+  {
+    std::cerr << message << std::endl;
+    ++errors;
+  }
+
+  // Tables of names and those they lead to, a batch of the schedule at a
+  // time on several threads like tbgen
+  tablebase_generator::tables_t generate(std::vector<std::string> names)
+  {
+    std::set<std::string> needed;
+    while (not names.empty())
+    {
+      std::string name = names.back();
+      names.pop_back();
+      if (needed.insert(name).second)
+        for (const auto& next : tablebase_generator::dependencies(name))
+          names.push_back(next);
+    }
+    tablebase_generator::tables_t tables;
+    for (const auto& batch : tablebase_generator::schedule(
+           Tablebase::max_pieces))
+    {
+      std::vector<std::string> todo;
+      for (const auto& name : batch)
+        if (needed.count(name))
+          todo.push_back(name);
+      std::vector<std::vector<uint8_t>> results(todo.size());
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < todo.size(); ++i)
+        threads.emplace_back([&, i]() {
+          results[i] = tablebase_generator::generate(todo[i], tables);
+        });
+      for (auto& thread : threads)
+        thread.join();
+      for (size_t i = 0; i < todo.size(); ++i)
+        tables[todo[i]] = std::move(results[i]);
+    }
+    return tables;
+  }
+
+  std::string fen_get(const std::vector<Tablebase::Piece>& pieces,
+                      plugin::Color side)
+  {
+    std::string cells(64, '1');
+    for (const auto& piece : pieces)
+    {
+      char c = static_cast<char>(piece.type);
+      cells[piece.square] = piece.color == plugin::Color::BLACK
+        ? std::tolower(c) : c;
+    }
+    std::string fen;
+    for (int rank = 7; rank >= 0; --rank)
+    {
+      fen += cells.substr(8 * rank, 8);
+      if (rank)
+        fen += '/';
+    }
+    return fen + (side == plugin::Color::WHITE ? " w" : " b") + " - - 0 1";
+  }
+
+  std::string result_name(Tablebase::Result result)
+  {
+    switch (result.outcome)
+    {
+      case Tablebase::Result::WIN:
+        return "win in " + std::to_string(result.plies);
+      case Tablebase::Result::LOSS:
+        return "loss in " + std::to_string(result.plies);
+      default:
+        return "draw";
+    }
+  }
+
+  void expect(const Tablebase& tablebase, const std::string& fen,
+              const std::string& expected)
+  {
+    Tablebase::Result result;
+    if (not tablebase.probe(ChessBoard(fen), result))
+      fail(fen + ": not in the tables");
+    else if (result_name(result) != expected)
+      fail(fen + ": " + result_name(result) + ", expected " + expected);
+  }
+
+  // Longest win of the table, -1 if it has none
+  int longest_win(const std::vector<uint8_t>& values)
+  {
+    int longest = -1;
+    for (uint8_t value : values)
+    {
+      auto result = Tablebase::result_get(value);
+      if (result.outcome == Tablebase::Result::WIN)
+        longest = std::max(longest, result.plies);
+    }
+    return longest;
+  }
+
+  // Every legal position of the table probed from a board, as it is and
+  // with the colors swapped, gives the stored value
+  void probe_all(const Tablebase& tablebase, const std::string& name,
+                 const std::vector<uint8_t>& values)
+  {
+    auto layout = Tablebase::layout_get(name);
+    squares_t squares;
+    plugin::Color side;
+    for (size_t index = 0; index < layout.size; ++index)
+    {
+      if (not Tablebase::position_get(layout, index, squares, side))
+        continue;
+      std::vector<Tablebase::Piece> pieces = layout.pieces;
+      std::vector<Tablebase::Piece> swapped = layout.pieces;
+      for (size_t i = 0; i < pieces.size(); ++i)
+      {
+        pieces[i].square = squares[i];
+        swapped[i] = {!pieces[i].color, pieces[i].type, squares[i] ^ 56};
+      }
+      ChessBoard board(fen_get(pieces, side));
+      if (RuleChecker::isCheck(board, board.get_king_position(!side)))
+        continue;
+      auto expected = result_name(Tablebase::result_get(values[index]));
+      for (const auto& fen : {fen_get(pieces, side), fen_get(swapped, !side)})
+      {
+        Tablebase::Result result;
+        if (not tablebase.probe(ChessBoard(fen), result)
+            or result_name(result) != expected)
+        {
+          fail(fen + ": probe differs from " + expected + " in " + name);
+          return;
+        }
+      }
+    }
+  }
+
+  void three_pieces()
+  {
+    auto tables = generate({"KQvK", "KRvK", "KBvK", "KNvK", "KPvK"});
+    Tablebase::save("tablebase-test-3.bin", tables);
+    Tablebase tablebase;
+    if (not tablebase.open("tablebase-test-3.bin"))
+    {
+      fail("Cannot open the tables");
+      return;
+    }
+    // Mates in 10 and 16 moves at most
+    if (longest_win(tables["KQvK"]) != 19)
+      fail("Longest KQvK win in " + std::to_string(longest_win(tables["KQvK"]))
+           + " plies, expected 19");
+    if (longest_win(tables["KRvK"]) != 31)
+      fail("Longest KRvK win in " + std::to_string(longest_win(tables["KRvK"]))
+           + " plies, expected 31");
+    for (auto name : {"KBvK", "KNvK"})
+      if (std::any_of(tables[name].begin(), tables[name].end(),
+                      [](uint8_t value) { return value != 0; }))
+        fail(std::string(name) + " has a position that is not a draw");
+
+    // c8=Q is mate, on each wing and for each color
+    expect(tablebase, "k7/2P5/1K6/8/8/8/8/8 w - - 0 1", "win in 1");
+    expect(tablebase, "7k/5P2/6K1/8/8/8/8/8 w - - 0 1", "win in 1");
+    expect(tablebase, "8/8/8/8/8/1k6/2p5/K7 b - - 0 1", "win in 1");
+    // Black to move has no move left
+    expect(tablebase, "k7/2P5/1K6/8/8/8/8/8 b - - 0 1", "draw");
+    // The king in front of a rook pawn holds
+    expect(tablebase, "k7/8/8/8/8/8/P7/K7 w - - 0 1", "draw");
+    // The king on the sixth rank in front of its pawn wins whoever moves
+    expect(tablebase, "4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", "win in 21");
+    expect(tablebase, "4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", "loss in 24");
+    expect(tablebase, "8/8/8/8/4p3/4k3/8/4K3 w - - 0 1", "loss in 24");
+    // Further back it only wins with the opposition
+    expect(tablebase, "8/4k3/8/4K3/4P3/8/8/8 w - - 0 1", "draw");
+    expect(tablebase, "8/4k3/8/4K3/4P3/8/8/8 b - - 0 1", "loss in 28");
+    expect(tablebase, "8/8/8/4p3/4k3/8/4K3/8 w - - 0 1", "loss in 28");
+
+    for (auto name : {"KQvK", "KRvK", "KPvK"})
+      probe_all(tablebase, name, tables[name]);
+  }
+
+  void en_passant()
+  {
+    auto tables = generate({"KPvKP"});
+    Tablebase::save("tablebase-test-kpkp.bin", tables);
+    Tablebase tablebase;
+    if (not tablebase.open("tablebase-test-kpkp.bin"))
+    {
+      fail("Cannot open the tables");
+      return;
+    }
+    // a4 is answered by bxa3 and a3 by b3, with the black king too far to
+    // stop the a-pawn the race is drawn
+    expect(tablebase, "7k/8/8/8/1p6/8/P7/K7 w - - 0 1", "draw");
+    expect(tablebase, "k7/p7/8/1P6/8/8/8/7K b - - 0 1", "draw");
+    // Close enough the black king still loses, later than without bxa3
+    expect(tablebase, "8/8/8/8/1p6/8/P7/K2k4 w - - 0 1", "win in 37");
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string test = argc > 1 ? argv[1] : "";
+  if (test == "3")
+    three_pieces();
+  else if (test == "en-passant")
+    en_passant();
+  else
+  {
+    std::cerr << "Usage: " << argv[0] << " 3|en-passant" << std::endl;
+    return 2;
+  }
+  return errors ? 1 : 0;
+}